@@ -0,0 +1,97 @@
+/**
+ * File:		arena.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	A bump allocator for objects that all live exactly as long as
+ * 				one translation.  Nothing is freed individually, the whole
+ * 				arena is given back at once with arena_release().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+static struct arena_chunk *new_chunk(size_t size);
+
+/**
+ * Creates an empty arena. The first chunk is made on the first allocation.
+ *
+ * @param	chunk_size	The size of each chunk, 0 uses ARENA_CHUNK.
+ * @return				The arena, or 0 if out of memory.
+ */
+struct arena *arena_create(size_t chunk_size){
+	struct arena *mem = (struct arena *) malloc(sizeof(struct arena));
+	if(!mem)
+		return 0;
+	mem->head = 0;
+	mem->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK;
+	mem->total = 0;
+	return mem;
+}
+
+/**
+ * Frees every chunk and the arena itself. All memory handed out by the arena
+ * is invalid afterwards.
+ */
+void arena_release(struct arena *mem){
+	if(!mem)
+		return;
+	struct arena_chunk *c = mem->head;
+	struct arena_chunk *next;
+	while(c){
+		next = c->next;
+		free(c);
+		c = next;
+	}
+	free(mem);
+}
+
+/**
+ * Hands out size bytes of zeroed memory. Requests larger than a chunk get a
+ * chunk of their own.
+ *
+ * @param	mem		The arena to allocate from.
+ * @param	size	The number of bytes needed.
+ * @return			The memory, or 0 if out of memory.
+ */
+void *arena_alloc(struct arena *mem, size_t size){
+	size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	struct arena_chunk *c = mem->head;
+	if(!c || c->size - c->used < size){
+		c = new_chunk(size > mem->chunk_size ? size : mem->chunk_size);
+		if(!c)
+			return 0;
+		c->next = mem->head;
+		mem->head = c;
+	}
+	void *p = c->data + c->used;
+	c->used += size;
+	mem->total += size;
+	return p;
+}
+
+/**
+ * Copies len characters of str into the arena and nul-terminates the copy.
+ */
+char *arena_strndup(struct arena *mem, const char *str, size_t len){
+	char *s = (char *) arena_alloc(mem, len + 1);
+	if(!s)
+		return 0;
+	if(str)
+		strncpy(s, str, len);
+	s[len] = '\0';
+	return s;
+}
+
+/**
+ * Chunks come from calloc so that everything the arena hands out starts
+ * zeroed.
+ */
+static struct arena_chunk *new_chunk(size_t size){
+	struct arena_chunk *c = (struct arena_chunk *) calloc(1, 
+			sizeof(struct arena_chunk) + size);
+	if(!c)
+		return 0;
+	c->size = size;
+	return c;
+}
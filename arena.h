@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Sizing
+#define ARENA_CHUNK		4096	// default bytes per chunk
+#define ARENA_ALIGN		8 		// every allocation is aligned to this
+
+/**
+ * arena_chunk
+ * struct arena_chunk *next		The previously filled chunk
+ * size_t size					Usable bytes in data
+ * size_t used					Bytes of data already handed out
+ * char data[]					The memory itself
+ */
+struct arena_chunk{
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/**
+ * arena
+ * struct arena_chunk *head		The chunk currently being allocated from
+ * size_t chunk_size			The size of each newly created chunk
+ * size_t total					Bytes handed out over the life of the arena
+ */
+struct arena{
+	struct arena_chunk *head;
+	size_t chunk_size;
+	size_t total;
+};
+
+// Arena Lifetime
+struct arena *arena_create(size_t chunk_size);
+void arena_release(struct arena *mem);
+
+// Allocation
+void *arena_alloc(struct arena *mem, size_t size);
+char *arena_strndup(struct arena *mem, const char *str, size_t len);
+
+#endif
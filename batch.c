@@ -0,0 +1,419 @@
+/**
+ * File:		batch.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Runs many Hartz machines with the same program in lockstep,
+ * 				for checking a program against every input it could be given.
+ * 				A machine is only a few dozen bytes, so a batch keeps each
+ * 				field for all of its lanes side by side and carries out an
+ * 				instruction for every lane at once, in loops over the lanes
+ * 				the compiler vectorizes.
+ *
+ * 				Lanes that branch differently (BEZ, or anything that depends
+ * 				on a register or the data ring) end up at different text
+ * 				positions.  Each step runs the instruction under the first
+ * 				running lane's head, masked to the lanes whose head is at the
+ * 				same position, and the others wait their turn.  Lanes that
+ * 				come back together run together again.  Every lane ends in
+ * 				exactly the state run_machine() would have left it in.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "dispatch.h"
+#include "batch.h"
+
+// Lane Status
+#define BATCH_RUNNING	-1	// otherwise one of the RUN_* results
+
+/**
+ * machine_batch
+ * The machines of a batch, stored by field rather than by machine so that one
+ * instruction can be carried out for every lane with a single loop the
+ * compiler turns into vector code. Lanes only differ in their registers, data
+ * ring and where they are in the program. The counters only hold what was
+ * spent since they were last added back into the machines, which keeps them
+ * narrow (more lanes to a vector) and the batch small.
+ *
+ * int count						Lanes in use
+ * unsigned char regs[][]			Each register, by lane
+ * unsigned char data[][]			Each data ring position, by lane
+ * unsigned char dp[]				Data ring head, by lane
+ * unsigned char tp[]				Text ring head, by lane
+ * unsigned char jump[]				Jump register, by lane
+ * unsigned char mult[]				Pending LJMP multiplier, by lane
+ * signed char status[]				BATCH_RUNNING or how the lane stopped
+ * signed char fault_pos[]			Position of an illegal instruction
+ * unsigned short cycles[]			Cycles since the last flush, by lane
+ * unsigned short executed[]		Instructions since the last flush
+ * unsigned short counts[][]		Each instruction since the last flush
+ * unsigned short budget[]			Cycles left before the limit, at most
+ * 									what a flush interval can use
+ * unsigned long ran				Bit per instruction run since the last flush
+ */
+struct machine_batch{
+	int count;
+	unsigned char regs[MAX_REGS][BATCH_LANES];
+	unsigned char data[MAX_CACHE][BATCH_LANES];
+	unsigned char dp[BATCH_LANES];
+	unsigned char tp[BATCH_LANES];
+	unsigned char jump[BATCH_LANES];
+	unsigned char mult[BATCH_LANES];
+	signed char status[BATCH_LANES];
+	signed char fault_pos[BATCH_LANES];
+	unsigned short cycles[BATCH_LANES];
+	unsigned short executed[BATCH_LANES];
+	unsigned short counts[SIM_OPS][BATCH_LANES];
+	unsigned short budget[BATCH_LANES];
+	unsigned long ran;
+};
+
+// Every lane of a batch, running or not, so the loops have a fixed length
+#define EACH_LANE	for(l = 0; l < BATCH_LANES; l++)
+
+// The new value for the lanes in mask (0xFF), the old one for the rest, with
+// no branch in the way of vectorizing the loop
+#define PICK(m, new, old)	(((m) & (new)) | (~(m) & (old)))
+
+// The word under each lane's data ring head into vals, and back from it for
+// the lanes in mask; both go through every position of the ring, since each
+// lane's head can be somewhere else
+#define READ_DATA(vals) do{ \
+	memset(vals, 0, BATCH_LANES); \
+	for(i = 0; i < MAX_CACHE; i++) \
+		EACH_LANE \
+			vals[l] |= b->data[i][l] & -(dp[l] == i); \
+}while(0)
+#define WRITE_DATA(vals) do{ \
+	for(i = 0; i < MAX_CACHE; i++) \
+		EACH_LANE \
+			b->data[i][l] = PICK(mask[l] & -(dp[l] == i), vals[l], \
+					b->data[i][l]); \
+}while(0)
+
+static void load_batch(struct machine_batch *b, const struct machine *ms,
+		int count);
+static void store_batch(const struct machine_batch *b, struct machine *ms);
+static void execute(struct machine_batch *b, const struct insn *ip, int pos);
+static void flush_counters(struct machine_batch *b, struct machine *ms,
+		unsigned long max_cycles);
+
+/**
+ * Runs up to BATCH_LANES machines loaded with the same program in lockstep,
+ * until each halts, faults or uses up the cycle limit, leaving every one as
+ * run_machine() would.
+ *
+ * @param	ms			The machines.
+ * @param	count		The number of machines, at most BATCH_LANES.
+ * @param	d			The decoded text ring of their program.
+ * @param	max_cycles	The most cycles any machine runs for, 0 for no limit.
+ * @return				The number of machines that halted.
+ */
+int run_batch(struct machine *ms, int count, const struct decoded_ring *d,
+		unsigned long max_cycles){
+	struct machine_batch b;
+	int l, lead, steps = 0, halted = 0;
+	load_batch(&b, ms, count);
+	flush_counters(&b, ms, max_cycles);
+	for(;;){
+		EACH_LANE
+			b.status[l] = PICK(-((b.status[l] == BATCH_RUNNING) &
+					(b.cycles[l] >= b.budget[l])), RUN_LIMIT, b.status[l]);
+		for(l = 0; l < count && b.status[l] != BATCH_RUNNING; l++)
+			;
+		if(l == count)
+			break;
+		lead = b.tp[l];
+		execute(&b, &d->code[lead], lead);
+		if(++steps == BATCH_FLUSH){
+			flush_counters(&b, ms, max_cycles);
+			steps = 0;
+		}
+	}
+	flush_counters(&b, ms, max_cycles);
+	store_batch(&b, ms);
+	for(l = 0; l < count; l++)
+		halted += b.status[l] == RUN_HALTED;
+	return halted;
+}
+
+/**
+ * Runs any number of machines loaded with the same program, BATCH_LANES at a
+ * time, see run_batch().
+ *
+ * @param	ms			The machines, all with the text ring of the first.
+ * @param	count		The number of machines.
+ * @param	max_cycles	The most cycles any machine runs for, 0 for no limit.
+ * @return				The number of machines that halted.
+ */
+size_t run_many(struct machine *ms, size_t count, unsigned long max_cycles){
+	struct decoded_ring d;
+	size_t done, halted = 0;
+	int n;
+	if(!count)
+		return 0;
+	predecode(&ms[0], &d);
+	for(done = 0; done < count; done += n){
+		n = count - done < BATCH_LANES ? count - done : BATCH_LANES;
+		halted += run_batch(&ms[done], n, &d, max_cycles);
+	}
+	return halted;
+}
+
+/**
+ * Fills a batch from the machines, with the counters cleared. Lanes past
+ * count are left stopped.
+ */
+static void load_batch(struct machine_batch *b, const struct machine *ms,
+		int count){
+	int l, i;
+	memset(b, 0, sizeof(struct machine_batch));
+	b->count = count;
+	memset(b->status, RUN_HALTED, BATCH_LANES);
+	for(l = 0; l < count; l++){
+		const struct machine *m = &ms[l];
+		for(i = 0; i < MAX_REGS; i++)
+			b->regs[i][l] = m->regs[i];
+		for(i = 0; i < MAX_CACHE; i++)
+			b->data[i][l] = m->data[i];
+		b->dp[l] = m->dp;
+		b->tp[l] = m->tp;
+		b->jump[l] = m->jump;
+		b->mult[l] = m->mult;
+		b->status[l] = m->halted ? RUN_HALTED : BATCH_RUNNING;
+		b->fault_pos[l] = m->fault_pos;
+	}
+}
+
+/**
+ * Copies the state of each lane back to its machine, all but the counters,
+ * see flush_counters().
+ */
+static void store_batch(const struct machine_batch *b, struct machine *ms){
+	int l, i;
+	for(l = 0; l < b->count; l++){
+		struct machine *m = &ms[l];
+		for(i = 0; i < MAX_REGS; i++)
+			m->regs[i] = b->regs[i][l];
+		for(i = 0; i < MAX_CACHE; i++)
+			m->data[i] = b->data[i][l];
+		m->dp = b->dp[l];
+		m->tp = b->tp[l];
+		m->jump = b->jump[l];
+		m->mult = b->mult[l];
+		m->halted = b->status[l] == RUN_HALTED;
+		m->fault_pos = b->fault_pos[l];
+	}
+}
+
+/**
+ * Carries out one instruction for the running lanes whose text head is on it,
+ * see step_machine().
+ *
+ * @param	b		The batch.
+ * @param	ip		The decoded instruction.
+ * @param	pos		The text position it was decoded from.
+ */
+static void execute(struct machine_batch *b, const struct insn *ip, int pos){
+
+	// everything read more than once is copied to locals, which the compiler
+	// knows the stores to the lanes can't overwrite; otherwise it would have
+	// to reload them, or check at run time before vectorizing a loop
+	const struct insn in = *ip;
+	unsigned char mask[BATCH_LANES], dp[BATCH_LANES];
+	unsigned char x[BATCH_LANES], y[BATCH_LANES], z[BATCH_LANES];
+	int l, i, dst;
+	EACH_LANE
+		mask[l] = -((b->status[l] == BATCH_RUNNING) & (b->tp[l] == pos));
+	memcpy(x, b->regs[in.a], BATCH_LANES);
+	memcpy(y, b->regs[in.b], BATCH_LANES);
+	memcpy(dp, b->dp, BATCH_LANES);
+
+	if(in.op < 0){
+		EACH_LANE{
+			b->cycles[l] += mask[l] & CYC_WORD;
+			b->fault_pos[l] = PICK(mask[l], pos, b->fault_pos[l]);
+			b->tp[l] = PICK(mask[l], in.next, b->tp[l]);
+			b->status[l] = PICK(mask[l], RUN_ILLEGAL, b->status[l]);
+		}
+		return;
+	}
+
+	// reading the instruction and its operands, the same for every op
+	b->ran |= 1UL << in.op;
+	EACH_LANE{
+		b->counts[in.op][l] += mask[l] & 1;
+		b->executed[l] += mask[l] & 1;
+		b->cycles[l] += mask[l] & in.cost;
+		b->tp[l] = PICK(mask[l], in.next, b->tp[l]);
+	}
+
+	// the register writes leave the result in z and the register in dst,
+	// the jumps how far to jump in z and the lanes that jump in y
+	switch(in.op){
+		case OP_NOT:
+			EACH_LANE
+				z[l] = ~x[l] & WORD_MASK;
+			dst = in.b;
+			break;
+		case OP_SHL:
+			EACH_LANE
+				z[l] = (x[l] << 1) & WORD_MASK;
+			dst = in.b;
+			break;
+		case OP_SHR:
+			EACH_LANE
+				z[l] = x[l] >> 1;
+			dst = in.b;
+			break;
+		case OP_OR:
+			EACH_LANE
+				z[l] = x[l] | y[l];
+			dst = in.c;
+			break;
+		case OP_AND:
+			EACH_LANE
+				z[l] = x[l] & y[l];
+			dst = in.c;
+			break;
+		case OP_ADD:
+			EACH_LANE
+				z[l] = (x[l] + y[l]) & WORD_MASK;
+			dst = in.c;
+			break;
+		case OP_LW:
+			READ_DATA(z);
+			dst = in.a;
+			break;
+		case OP_LI:
+			memset(z, in.v1, BATCH_LANES);
+			dst = in.a;
+			break;
+		case OP_SW:
+			WRITE_DATA(x);
+			return;
+		case OP_SI:
+			memset(z, in.v1, BATCH_LANES);
+			WRITE_DATA(z);
+			return;
+		case OP_ROT:
+			EACH_LANE{
+				unsigned char steps = mask[l] & (x[l] % MAX_CACHE);
+				dp[l] += steps;
+				b->dp[l] = dp[l] >= MAX_CACHE ? dp[l] - MAX_CACHE : dp[l];
+				b->cycles[l] += steps * CYC_STEP;
+			}
+			return;
+		case OP_ROT1:
+		case OP_LROT:
+			EACH_LANE{
+				dp[l] += mask[l] & (in.op == OP_ROT1 ? 1 : in.v1 % MAX_CACHE);
+				b->dp[l] = dp[l] >= MAX_CACHE ? dp[l] - MAX_CACHE : dp[l];
+			}
+			return;
+		case OP_HALT:
+			EACH_LANE
+				b->status[l] = PICK(mask[l], RUN_HALTED, b->status[l]);
+			return;
+		case SIM_LJMP:
+			EACH_LANE
+				b->mult[l] = PICK(mask[l], in.v1, b->mult[l]);
+			return;
+		case OP_BEZ:
+			EACH_LANE
+				y[l] = mask[l] & -(x[l] == 0);
+			memset(z, in.v1, BATCH_LANES);
+			dst = -1;
+			break;
+		case OP_JMP:
+			memcpy(y, mask, BATCH_LANES);
+			memset(z, in.v1, BATCH_LANES);
+			dst = -1;
+			break;
+		case OP_LFSJ:
+			READ_DATA(z);
+			EACH_LANE{
+				z[l] = (in.v1 - z[l]) & WORD_MASK;
+				b->jump[l] = PICK(mask[l], z[l], b->jump[l]);
+			}
+			memcpy(y, mask, BATCH_LANES);
+			dst = -1;
+			break;
+		case OP_STJ:
+			memset(z, in.v1, BATCH_LANES);
+			WRITE_DATA(z);
+			EACH_LANE
+				b->jump[l] = PICK(mask[l], in.v2, b->jump[l]);
+			memcpy(y, mask, BATCH_LANES);
+			memset(z, in.v2, BATCH_LANES);
+			dst = -1;
+			break;
+		default:
+			return;
+	}
+
+	if(dst >= 0){
+		memcpy(x, b->regs[dst], BATCH_LANES);
+		EACH_LANE
+			x[l] = PICK(mask[l], z[l], x[l]);
+		memcpy(b->regs[dst], x, BATCH_LANES);
+		return;
+	}
+
+	// with no multiplier pending, a jump by the operand word lands where
+	// predecode() worked out
+	if(in.op != OP_LFSJ){
+		unsigned char pending = 0;
+		EACH_LANE
+			pending |= b->mult[l] & y[l];
+		if(!pending){
+			EACH_LANE{
+				b->tp[l] = PICK(y[l], in.target, b->tp[l]);
+				b->cycles[l] += y[l] & in.jcost;
+			}
+			return;
+		}
+	}
+
+	// otherwise rotate the text ring of the lanes that jump, applying (and
+	// clearing) any pending LJMP multiplier of each
+	EACH_LANE{
+		unsigned short steps = z[l] * (b->mult[l] | !b->mult[l]) %
+				MAX_MEMORY & (y[l] & 1 ? 0xFF : 0);
+		unsigned char tp = in.next + steps;
+		tp = tp >= MAX_MEMORY ? tp - MAX_MEMORY : tp;
+		b->tp[l] = PICK(y[l], tp, b->tp[l]);
+		b->cycles[l] += steps * CYC_STEP;
+		b->mult[l] &= ~y[l];
+	}
+}
+
+/**
+ * Adds the counters into the machines and clears them, then works out how
+ * many cycles each lane may run before the next flush.
+ */
+static void flush_counters(struct machine_batch *b, struct machine *ms,
+		unsigned long max_cycles){
+	unsigned long left;
+	int l, i;
+	for(i = 0; i < SIM_OPS; i++){
+		if(!(b->ran & (1UL << i)))
+			continue;
+		for(l = 0; l < b->count; l++)
+			ms[l].counts[i] += b->counts[i][l];
+		memset(b->counts[i], 0, sizeof(b->counts[i]));
+	}
+	b->ran = 0;
+	for(l = 0; l < b->count; l++){
+		ms[l].cycles += b->cycles[l];
+		ms[l].executed += b->executed[l];
+		left = max_cycles > ms[l].cycles ? max_cycles - ms[l].cycles : 0;
+		b->budget[l] = !max_cycles || left > USHRT_MAX ? USHRT_MAX : left;
+	}
+	memset(b->cycles, 0, sizeof(b->cycles));
+	memset(b->executed, 0, sizeof(b->executed));
+}
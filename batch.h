@@ -0,0 +1,19 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+// Machines run together in one batch, a multiple of the widest vector
+// registers
+#define BATCH_LANES		64
+
+// Steps between adding the narrow per step counters back into the machines;
+// a step costs less than 64 cycles, so they can't overflow in between
+#define BATCH_FLUSH		1024
+
+// Lockstep Execution
+int run_batch(struct machine *ms, int count, const struct decoded_ring *d,
+		unsigned long max_cycles);
+size_t run_many(struct machine *ms, size_t count, unsigned long max_cycles);
+
+#endif
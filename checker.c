@@ -0,0 +1,401 @@
+/**
+* File: checker.c
+* Author: Grant Kurtz
+*
+* Description: Works out, before a program is ever run, whether it always
+* halts and how many cycles it can take. The program is started with every
+* combination of values of the chosen input words (both registers unless told
+* otherwise) and every state it can reach is explored. Since a state has only
+* one successor, each start is followed until it halts, faults, or reaches a
+* state already explored, whose outcome is then shared by every state on the
+* way there; a state reached again on the same path is a loop. The answer is
+* exact for the inputs explored.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "states.h"
+#include "source.h"
+#include "idents.h"
+#include "strlib.h"
+#include "generrors.h"
+
+// Flags
+#define INPUT_FLAG	"-i"	// followed by the input words, "r1,r2,d0,..."
+#define REGS_FLAG	"-r"	// followed by the fixed registers, "$1,$2"
+#define DATA_FLAG	"-d"	// followed by the fixed data ring, "d0,d1,..."
+#define STATES_FLAG	"-s"	// followed by the most states to explore
+
+// Exploration Sizing
+#define MAX_INPUTS	3			// 128^3 starts is already two million
+#define DEF_STATES	(1 << 22)	// about 200MB of states
+
+// Input Words
+// Indices into the words a start can vary: the registers, then the data ring
+#define IN_WORDS	(MAX_REGS + MAX_CACHE)
+
+// State Values
+// What is kept for each explored state (see struct state_slot)
+#define ON_PATH		1	// on the path being followed
+#define LOOPS		2	// never halts
+#define FAULTS		3	// runs into an illegal instruction
+#define HALTS		4	// halts, in (value - HALTS) more cycles
+
+// Reasons to Give Up
+#define OUT_OF_STATES	1	// the state limit was reached
+#define OUT_OF_MEMORY	2	// the states explored don't fit in memory
+
+/**
+* reach_report
+* unsigned long starts		Starts explored
+* unsigned long halts		Starts that halt
+* unsigned long loops		Starts that never halt
+* unsigned long faults		Starts that reach an illegal instruction
+* unsigned long worst		The most cycles any start takes to halt
+* unsigned long worst_in	The first start taking that long
+* unsigned long loop_in		The first start that never halts
+* unsigned long fault_in	The first start that faults
+* short gave_up				Why the exploration stopped early (OUT_OF_*), or 0
+*/
+struct reach_report{
+	unsigned long starts;
+	unsigned long halts;
+	unsigned long loops;
+	unsigned long faults;
+	unsigned long worst;
+	unsigned long worst_in;
+	unsigned long loop_in;
+	unsigned long fault_in;
+	short gave_up;
+};
+
+/**
+* reach_path
+* The states a start has passed through that don't have an outcome yet.
+*
+* unsigned char *keys		The packed states, STATE_BYTES each
+* unsigned long *costs		Cycles spent leaving each state
+* size_t len				The number of states on the path
+* size_t size				The room in keys and costs, in states
+*/
+struct reach_path{
+	unsigned char *keys;
+	unsigned long *costs;
+	size_t len;
+	size_t size;
+};
+
+static void explore(const struct machine *start, const int *inputs, int count,
+		size_t max_states, struct state_set *set, struct reach_report *rep);
+static unsigned long follow(struct machine *m, struct state_set *set,
+		struct reach_path *path, size_t max_states, short *gave_up);
+static void set_start(struct machine *m, const int *inputs, int count,
+		unsigned long start);
+static int read_inputs(const char *arg, int *inputs);
+static void print_start(const int *inputs, int count, unsigned long start);
+static void print_usage(const char *prog_name);
+
+int main(int argc, char **argv){
+	if(argc < 2 || argc % 2){
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	struct machine m;
+	int inputs[MAX_INPUTS] = {0, 1}, count = MAX_REGS, c;
+	size_t max_states = DEF_STATES;
+	reset_machine(&m);
+	for(c = 2; c < argc; c += 2){
+		if(strcmp(argv[c], INPUT_FLAG) == 0 &&
+				(count = read_inputs(argv[c+1], inputs)) > 0)
+			;
+		else if(strcmp(argv[c], REGS_FLAG) == 0 &&
+				read_values(argv[c+1], m.regs, MAX_REGS, MAX_INT) > 0)
+			;
+		else if(strcmp(argv[c], DATA_FLAG) == 0 &&
+				read_values(argv[c+1], m.data, MAX_CACHE, MAX_INT) > 0)
+			;
+		else if(strcmp(argv[c], STATES_FLAG) == 0)
+			max_states = strtoul(argv[c+1], 0, 10);
+		else{
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	FILE *in = fopen(argv[1], "r");
+	struct source src;
+	if(!in || open_source(&src, in)){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Unable to read '%s'.\n", argv[1]);
+		if(in)
+			fclose(in);
+		return 2;
+	}
+	fclose(in);
+	int words = load_program(&m, src.data, src.size);
+	close_source(&src);
+	if(words < 0){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: '%s' is not a program for this machine.\n",
+				argv[1]);
+		return 2;
+	}
+
+	struct state_set set;
+	struct reach_report rep;
+	init_state_set(&set);
+	explore(&m, inputs, count, max_states, &set, &rep);
+	if(rep.gave_up == OUT_OF_MEMORY){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Not enough memory available to explore "
+				"program!\n");
+		free_state_set(&set);
+		return ALLOC_ERR;
+	}
+
+	printf("\t\t=== Hartz Reachability ===\n");
+	printf("Starts:\t\t%lu\n", rep.starts);
+	printf("States:\t\t%zu\n", set.used);
+	if(rep.gave_up){
+		print_asterisk(YLW_C, stdout);
+		printf("Gave up after %zu states; raise the limit with %s.\n",
+				max_states, STATES_FLAG);
+	}
+	else if(rep.halts == rep.starts){
+		print_asterisk(GRN_C, stdout);
+		printf("HALT is always reached, in at most %lu cycles (",
+				rep.worst);
+		print_start(inputs, count, rep.worst_in);
+		printf(").\n");
+	}
+	else{
+		if(rep.loops){
+			print_asterisk(RED_C, stdout);
+			printf("%lu of %lu starts never halt, the first being ",
+					rep.loops, rep.starts);
+			print_start(inputs, count, rep.loop_in);
+			printf(".\n");
+		}
+		if(rep.faults){
+			print_asterisk(RED_C, stdout);
+			printf("%lu of %lu starts reach an illegal instruction, the "
+					"first being ", rep.faults, rep.starts);
+			print_start(inputs, count, rep.fault_in);
+			printf(".\n");
+		}
+		if(rep.halts){
+			print_asterisk(YLW_C, stdout);
+			printf("The other starts halt in at most %lu cycles (",
+					rep.worst);
+			print_start(inputs, count, rep.worst_in);
+			printf(").\n");
+		}
+	}
+	free_state_set(&set);
+	return rep.gave_up || rep.halts != rep.starts;
+}
+
+/**
+* Explores every start and what it leads to.
+*
+* @param start 		The loaded machine, with the words that aren't inputs
+* 					set.
+* @param inputs 	The input words, see IN_WORDS.
+* @param count 		The number of input words.
+* @param max_states The most states to explore before giving up.
+* @param set 		Filled with the explored states and their outcomes.
+* @param rep 		Filled with what was found.
+*/
+static void explore(const struct machine *start, const int *inputs, int count,
+		size_t max_states, struct state_set *set, struct reach_report *rep){
+	struct reach_path path = {0, 0, 0, 0};
+	unsigned long starts = 1, i, val;
+	struct machine m;
+	int j;
+	for(j = 0; j < count; j++)
+		starts *= MAX_INT + 1;
+
+	memset(rep, 0, sizeof(struct reach_report));
+	for(i = 0; i < starts; i++){
+		m = *start;
+		set_start(&m, inputs, count, i);
+		if(!(val = follow(&m, set, &path, max_states, &rep->gave_up)))
+			break;
+		rep->starts++;
+		if(val == LOOPS && !rep->loops++)
+			rep->loop_in = i;
+		else if(val == FAULTS && !rep->faults++)
+			rep->fault_in = i;
+		else if(val >= HALTS){
+			rep->halts++;
+			if(val - HALTS > rep->worst || rep->halts == 1){
+				rep->worst = val - HALTS;
+				rep->worst_in = i;
+			}
+		}
+	}
+	free(path.keys);
+	free(path.costs);
+}
+
+/**
+* Runs a machine until it halts, faults, or reaches an explored state, then
+* records the outcome for every state it passed through.
+*
+* @param m 			The machine, at its start.
+* @param set 		The explored states.
+* @param path 		Room to keep the states passed through.
+* @param max_states The most states to explore.
+* @param gave_up 	Set to why, if the start couldn't be followed to the end.
+* @return 			The outcome of the start (one of the state values), or
+* 					0 if the state limit was reached or memory ran out.
+*/
+static unsigned long follow(struct machine *m, struct state_set *set,
+		struct reach_path *path, size_t max_states, short *gave_up){
+	unsigned char key[STATE_BYTES];
+	struct state_slot *slot;
+	unsigned long val, before, *costs;
+	unsigned char *keys;
+	size_t size;
+	int found, ret;
+	path->len = 0;
+	for(;;){
+		pack_state(m, key);
+		if(!(slot = add_state(set, key, &found))){
+			*gave_up = OUT_OF_MEMORY;
+			return 0;
+		}
+		if(found){
+			val = slot->val == ON_PATH ? LOOPS : slot->val;
+			break;
+		}
+		if(set->used > max_states){
+			*gave_up = OUT_OF_STATES;
+			return 0;
+		}
+		slot->val = ON_PATH;
+
+		if(path->len == path->size){
+			size = path->size ? path->size * 2 : 64;
+			if((keys = (unsigned char *) realloc(path->keys,
+					size * STATE_BYTES)))
+				path->keys = keys;
+			if(!keys || !(costs = (unsigned long *) realloc(path->costs,
+					size * sizeof(unsigned long)))){
+				*gave_up = OUT_OF_MEMORY;
+				return 0;
+			}
+			path->costs = costs;
+			path->size = size;
+		}
+		memcpy(path->keys + path->len * STATE_BYTES, key, STATE_BYTES);
+		before = m->cycles;
+		ret = step_machine(m);
+		path->costs[path->len++] = m->cycles - before;
+		if(ret == RUN_HALTED){
+			val = HALTS;
+			break;
+		}
+		if(ret == RUN_ILLEGAL){
+			val = FAULTS;
+			break;
+		}
+	}
+
+	// every state on the way shares the outcome, a halt being further off
+	// the earlier the state
+	while(path->len){
+		path->len--;
+		if(val >= HALTS)
+			val += path->costs[path->len];
+		slot = add_state(set, path->keys + path->len * STATE_BYTES, &found);
+		if(!slot){
+			*gave_up = OUT_OF_MEMORY;
+			return 0;
+		}
+		slot->val = val;
+	}
+	return val;
+}
+
+/**
+* Sets the input words of a machine to the values of one start, the first
+* input word varying slowest.
+*/
+static void set_start(struct machine *m, const int *inputs, int count,
+		unsigned long start){
+	int j;
+	for(j = count - 1; j >= 0; j--){
+		unsigned char v = start % (MAX_INT + 1);
+		if(inputs[j] < MAX_REGS)
+			m->regs[inputs[j]] = v;
+		else
+			m->data[inputs[j] - MAX_REGS] = v;
+		start /= MAX_INT + 1;
+	}
+}
+
+/**
+* Reads the input words, a comma separated list of r1, r2, d0, ... d5.
+*
+* @return 			The number of input words, or -1 if one is malformed or
+* 					there are too many.
+*/
+static int read_inputs(const char *arg, int *inputs){
+	int n = 0;
+	char *end;
+	while(*arg){
+		long v = strtol(arg + 1, &end, 10);
+		if(n == MAX_INPUTS || end == arg + 1 || (*end && *end != ','))
+			return -1;
+		if(*arg == 'r' && v >= 1 && v <= MAX_REGS)
+			inputs[n++] = v - 1;
+		else if(*arg == 'd' && v >= 0 && v < MAX_CACHE)
+			inputs[n++] = MAX_REGS + v;
+		else
+			return -1;
+		arg = *end ? end + 1 : end;
+	}
+	return n;
+}
+
+/**
+* Prints the input words of one start, e.g. "$1=3 $2=0".
+*/
+static void print_start(const int *inputs, int count, unsigned long start){
+	unsigned char vals[MAX_INPUTS];
+	int j;
+	for(j = count - 1; j >= 0; j--){
+		vals[j] = start % (MAX_INT + 1);
+		start /= MAX_INT + 1;
+	}
+	for(j = 0; j < count; j++){
+		if(inputs[j] < MAX_REGS)
+			printf("%s$%d=%d", j ? " " : "", inputs[j] + 1, vals[j]);
+		else
+			printf("%sd%d=%d", j ? " " : "", inputs[j] - MAX_REGS, vals[j]);
+	}
+}
+
+/**
+* Prints how to call the checker.
+*/
+static void print_usage(const char *prog_name){
+	printf("usage: %s <program> [flags]\n"
+			"Explores every state a program written by the translator can "
+			"reach, and reports\nwhether it always halts and how many cycles "
+			"it takes at most.\n"
+			"Options (make separate):\n"
+			" -i <words>\tThe words that start with every value, up to %d of "
+			"r1,r2,d0,...,d5\n\t\t(default r1,r2)\n"
+			" -d <d0,...>\tStart with these values on the data ring\n"
+			" -r <$1,$2>\tStart with these values in the registers\n"
+			" -s <states>\tGive up after exploring this many states "
+			"(default %d)\n",
+			prog_name, MAX_INPUTS, DEF_STATES);
+}
@@ -15,6 +15,7 @@
 #include "strlib.h"
 #include "idents.h"
 #include "terms.h"
+#include "trace.h"
 
 int main(){
 
@@ -76,9 +77,7 @@ int parseFile(struct program *prog){
 
 	do{
 		prog->line_count++;
-		#ifdef DEBUG
-			fprintf(stderr, "*** Reading Line %d...\n", prog->line_count);
-		#endif
+		TRACE(prog, TRACE_READ, TRACE_LINE, "reading line");
 		// fgetpos(prog->in, &prog->str_line);
 		// tok = read_next_token(buf, prog->in, 64);
 		break;
@@ -0,0 +1,55 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+// Threaded dispatch needs the GNU "labels as values" extension, anything
+// else (or building with -DNO_THREADED) falls back to a switch
+#if defined(__GNUC__) && !defined(NO_THREADED)
+#define THREADED_DISPATCH
+#endif
+
+/**
+ * insn
+ * One text ring position, decoded ahead of time. The text ring is never
+ * written, so everything an instruction reads from it (its operand words and
+ * where it continues) is known before the program runs.
+ *
+ * const void *handler		Where the interpreter jumps to run it (threaded
+ * 							dispatch only)
+ * short op					The decoded instruction, see decode_word()
+ * unsigned char a, b, c	The operand bits after the code, in order
+ * unsigned char v1, v2		The operand words that follow on the text ring
+ * 							(the multiplier for LJMP)
+ * short next				Where the text head is after the instruction and
+ * 							its operands were read
+ * short target				Where a jump by v1 (v2 for STJ) lands
+ * unsigned char cost		Cycles to read the instruction and its operands,
+ * 							plus any fixed data ring rotation
+ * unsigned char jcost		Extra cycles when jumping to target
+ */
+struct insn{
+	const void *handler;
+	short op;
+	unsigned char a, b, c;
+	unsigned char v1, v2;
+	short next;
+	short target;
+	unsigned char cost;
+	unsigned char jcost;
+};
+
+/**
+ * decoded_ring
+ * struct insn code[]		Every text ring position, decoded
+ * short threaded			Set once the handlers have been filled in
+ */
+struct decoded_ring{
+	struct insn code[MAX_MEMORY];
+	short threaded;
+};
+
+// Decoded Execution
+void predecode(const struct machine *m, struct decoded_ring *d);
+int run_decoded(struct machine *m, struct decoded_ring *d,
+		unsigned long max_cycles);
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ * File:		fixups.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Translates operands while the input is still being read,
+ * 				instead of walking the finished term table again. An operand
+ * 				naming a label that is already placed is translated as soon
+ * 				as its instruction is; one naming anything else waits on the
+ * 				symbol's list of fixups and is patched the moment the label
+ * 				or function is placed. Only what is still waiting at the end
+ * 				of the file (constants and symbols never placed) is looked at
+ * 				after parsing.
+ *
+ * 				The words come out exactly as translate_terms() makes them,
+ * 				which is still used when the peephole pass moves terms
+ * 				around after parsing. A return goes back to the last
+ * 				function placed before it, which is always known by the time
+ * 				it is read. Errors are held back until the end and only the
+ * 				first one, in term order, is reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "symbols.h"
+#include "idents.h"
+#include "strlib.h"
+#include "generrors.h"
+#include "terms.h"
+#include "arena.h"
+#include "opcodes.h"
+#include "fixups.h"
+#include "trace.h"
+
+static void fix_operand(int o, struct program *prog);
+static void fix_call(int t, struct program *prog);
+static void wait_for(const char *iden, int t, struct program *prog);
+static void resolve_operand(int o, struct symbol *s, struct program *prog);
+static void resolve_call(int t, struct symbol *s, struct program *prog);
+static void resolve_return(int t, struct program *prog);
+static void note_fault(int t, struct program *prog);
+
+/**
+ * Translates the operands of an instruction that has just been read, or
+ * leaves them waiting on the symbols they name.
+ *
+ * @param	t		The position of the instruction, with all of its operands
+ * 					added.
+ * @param	prog	The program being read.
+ */
+void fix_operands(int t, struct program *prog){
+	struct term_table *tt = &prog->terms;
+	int i;
+	if(prog->opts.optimize)
+		return;
+
+	if(tt->ops[t] == OP_STJ){
+		fix_call(t, prog);
+	}
+	else if(tt->ops[t] == OP_LFSJ){
+		resolve_return(t, prog);
+	}
+	else{
+		for(i = 1; i < opcodes[tt->ops[t]].words; i++){
+			if(tt->kinds[t + i] != TERM_DONE)
+				fix_operand(t + i, prog);
+		}
+	}
+}
+
+/**
+ * Patches every term waiting on a label or function that has just been
+ * given its position.
+ *
+ * @param	s		The symbol, with its position set.
+ * @param	prog	The program being read.
+ */
+void fix_symbol(struct symbol *s, struct program *prog){
+	int t;
+	if(prog->opts.optimize)
+		return;
+	if(s->type == FUNC_TYPE)
+		prog->fix.cur_func = s;
+
+	struct symbol *p = find_symbol(s->iden, &prog->fix.pending);
+	if(!p)
+		return;
+	TRACE(prog, TRACE_RESOLVE, TRACE_LINE, "'%s' placed at %d, patching "
+			"what waits on it", s->iden, s->pos);
+	for(t = p->val; t; t = prog->terms.fixups[t]){
+		if(prog->terms.ops[t] == OP_STJ)
+			resolve_call(t, s, prog);
+		else
+			resolve_operand(t, s, prog);
+	}
+	p->val = 0;
+}
+
+/**
+ * Translates whatever is still waiting once the whole file has been read:
+ * constants, and symbols that were never placed. Reports the first
+ * term that couldn't be translated, if any.
+ *
+ * @param	prog	The program that has been read.
+ */
+void close_fixups(struct program *prog){
+	struct term_table *tt = &prog->terms;
+	struct symbol *p, *s;
+	int t;
+	for(p = prog->fix.pending.r; p; p = p->next){
+		for(t = p->val; t; t = tt->fixups[t]){
+			if(tt->ops[t] == OP_STJ){
+				if( (s = find_symbol(p->iden, prog->tbl)) )
+					resolve_call(t, s, prog);
+
+				// the empty return word is all that is left to complain
+				// about
+				else
+					note_fault(t + 1, prog);
+			}
+
+			// a function declared but never defined, or a constant
+			else if( (s = find_symbol(p->iden, prog->tbl)) ){
+				resolve_operand(t, s, prog);
+			}
+			else if( (s = find_symbol(p->iden, prog->const_tbl)) ){
+				s->used = 1;
+				tt->words[t] = s->val & WORD_MASK;
+				tt->kinds[t] = TERM_DONE;
+			}
+			else
+				note_fault(t, prog);
+		}
+	}
+
+	if(!(t = prog->fix.fault))
+		return;
+	if(tt->ops[t] == OP_STJ)
+		print_non_func_call(find_symbol(tt->refs[t + 2], prog->tbl), prog,
+				tt->lines[t]);
+	else if(tt->ops[t] == OP_LFSJ)
+		print_return_from_non_func(tt->lines[t], prog);
+	else
+		print_symbol_not_found(tt->refs[t], prog);
+}
+
+/**
+ * Translates a literal or label operand, or waits for its label. Constants
+ * wait until the end too, since a label of the same name defined later would
+ * be used instead.
+ */
+static void fix_operand(int o, struct program *prog){
+	struct term_table *tt = &prog->terms;
+	struct symbol *s;
+	if(check_explicit_literal(tt->refs[o], prog)){
+		tt->words[o] = stonum(tt->refs[o]+1) & WORD_MASK;
+		tt->kinds[o] = TERM_DONE;
+	}
+	else if((s = find_symbol(tt->refs[o], prog->tbl)) && s->pos >= 0)
+		resolve_operand(o, s, prog);
+	else
+		wait_for(tt->refs[o], o, prog);
+}
+
+/**
+ * Translates the operands of a call, or waits for the function.
+ */
+static void fix_call(int t, struct program *prog){
+	char *jmp_to = prog->terms.refs[t + 2];
+	struct symbol *s = find_symbol(jmp_to, prog->tbl);
+	if(s && s->pos >= 0)
+		resolve_call(t, s, prog);
+	else
+		wait_for(jmp_to, t, prog);
+}
+
+/**
+ * Adds a term to the list of those waiting on a symbol.
+ */
+static void wait_for(const char *iden, int t, struct program *prog){
+	struct symbol_table *pending = &prog->fix.pending;
+	struct symbol *p = find_symbol((char *) iden, pending);
+	if(!p){
+		add_symbol((char *) iden, 0, pending, 0, LABEL_TYPE);
+		p = pending->e;
+	}
+	prog->terms.fixups[t] = p->val;
+	p->val = t;
+}
+
+/**
+ * Sets an operand to the distance to a label.
+ */
+static void resolve_operand(int o, struct symbol *s, struct program *prog){
+	int diff = s->pos - o;
+	s->used = 1;
+	if(diff < 0)
+		diff = MAX_MEMORY + diff;
+	prog->terms.words[o] = diff & WORD_MASK;
+	prog->terms.kinds[o] = TERM_DONE;
+}
+
+/**
+ * Sets the operands of a call: the distance to the function and the word
+ * its return uses to come back, see translate_terms().
+ */
+static void resolve_call(int t, struct symbol *s, struct program *prog){
+	struct term_table *tt = &prog->terms;
+	int jmp_back = t + 1, jmp_to = t + 2;
+	if(s->type != FUNC_TYPE){
+		note_fault(t, prog);
+		return;
+	}
+	int diff = s->pos - t - 2;
+	if(diff < 0)
+		diff = MAX_MEMORY + diff;
+	tt->words[jmp_back] = diff & WORD_MASK;
+	tt->kinds[jmp_back] = TERM_DONE;
+	tt->words[jmp_to] = diff & WORD_MASK;
+	tt->kinds[jmp_to] = TERM_DONE;
+}
+
+/**
+ * Sets the operand of a return to the distance back to its function, see
+ * translate_terms().
+ */
+static void resolve_return(int t, struct program *prog){
+	struct symbol *f = prog->fix.cur_func;
+	if(!f){
+		note_fault(t, prog);
+		return;
+	}
+
+	// the word after the LFSJ
+	t++;
+	int diff = f->pos - t;
+	if(diff < 0)
+		diff = MAX_MEMORY + diff;
+	prog->terms.words[t] = (diff + MAX_MEMORY) & WORD_MASK;
+	prog->terms.kinds[t] = TERM_DONE;
+}
+
+/**
+ * Remembers a term that can't be translated, keeping the first one.
+ */
+static void note_fault(int t, struct program *prog){
+	if(!prog->fix.fault || t < prog->fix.fault)
+		prog->fix.fault = t;
+}
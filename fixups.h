@@ -0,0 +1,12 @@
+#ifndef FIXUPS_H
+#define FIXUPS_H
+
+struct program;
+struct symbol;
+
+// One Pass Translation
+void fix_operands(int t, struct program *prog);
+void fix_symbol(struct symbol *s, struct program *prog);
+void close_fixups(struct program *prog);
+
+#endif
@@ -1,17 +1,145 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 #include "generrors.h"
 #include "symbols.h"
+#include "idents.h"
+#include "strlib.h"
+
+static void report(struct program *prog, short severity, short code, 
+		int line, short show_src, const char *fmt, va_list args);
+static void add_diagnostic(struct program *prog, short severity, short code,
+		int line, short show_src, const char *fmt, va_list args);
+
+/**
+ * Reports an error on the line currently being read, showing that line, and
+ * stops the translation with the given code.
+ *
+ * @param	prog	The program being translated.
+ * @param	code	The error code to stop with.
+ * @param	fmt		printf() style message, without decoration.
+ */
+void report_error(struct program *prog, short code, const char *fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	report(prog, DIAG_ERROR, code, prog->line_count, 1, fmt, args);
+	va_end(args);
+	prog->error_code = code;
+}
+
+/**
+ * Reports a problem found away from the line being read, such as while
+ * resolving symbols. Errors also stop the translation with the given code.
+ *
+ * @param	prog		The program being translated.
+ * @param	severity	DIAG_ERROR or DIAG_WARNING.
+ * @param	code		The error code to stop with, ignored for warnings.
+ * @param	line		Where the problem is, or NO_LINE.
+ * @param	fmt			printf() style message, without decoration.
+ */
+void report_at(struct program *prog, short severity, short code, int line,
+		const char *fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	report(prog, severity, severity == DIAG_ERROR ? code : 0, line, 0, fmt, 
+			args);
+	va_end(args);
+	if(severity == DIAG_ERROR)
+		prog->error_code = code;
+}
+
+/**
+ * Releases every diagnostic collected into the list.
+ */
+void free_diagnostics(struct diag_list *diags){
+	size_t i;
+	for(i = 0; i < diags->count; i++){
+		free(diags->items[i].msg);
+		free(diags->items[i].src);
+	}
+	free(diags->items);
+	memset(diags, 0, sizeof(struct diag_list));
+}
 
 void print_memory_error(struct program *prog){
-	fprintf(stderr, "Not enough memory available to process program!\n"
-			"Exiting...\n");
-	prog->error_code = ALLOC_ERR;
+	report_at(prog, DIAG_ERROR, ALLOC_ERR, NO_LINE, 
+			"Not enough memory available to process program!");
 }
 
 void print_fault(const char* reason, struct program *prog){
-	fprintf(stderr, "Whoops! The compiler has a bug! Failure Reason:\n"
-			"\t%s", reason);
-	prog->error_code = 4;
+	report_at(prog, DIAG_ERROR, FAULT, NO_LINE, 
+			"Whoops! The compiler has a bug! Failure Reason: %s", reason);
 }
 
+/**
+ * Either collects a diagnostic (when the program has a list for them) or
+ * prints it in the usual format: where it happened, optionally the source
+ * line, and then the message itself.
+ */
+static void report(struct program *prog, short severity, short code, 
+		int line, short show_src, const char *fmt, va_list args){
+	if(prog->diags){
+		add_diagnostic(prog, severity, code, line, show_src, fmt, args);
+		return;
+	}
+
+	const char *color = severity == DIAG_ERROR ? RED_C : YLW_C;
+	if(show_src)
+		print_compiler_error(prog, color);
+	else{
+		print_asterisk(color, prog->err);
+		if(line == NO_LINE)
+			fprintf(prog->err, "%s:\n", prog->input);
+		else
+			fprintf(prog->err, "%s, %d:\n", prog->input, line);
+	}
+	print_asterisk(color, prog->err);
+	fprintf(prog->err, severity == DIAG_ERROR ? "\t" : "\tWarning: ");
+	vfprintf(prog->err, fmt, args);
+	fprintf(prog->err, "\n");
+}
+
+/**
+ * Appends a diagnostic to the program's list. Running out of memory here
+ * just loses the diagnostic, the error code is still set by the caller.
+ */
+static void add_diagnostic(struct program *prog, short severity, short code,
+		int line, short show_src, const char *fmt, va_list args){
+	struct diag_list *diags = prog->diags;
+	if(diags->count == diags->size){
+		size_t size = diags->size ? diags->size * 2 : 8;
+		struct diagnostic *items = (struct diagnostic *) realloc(diags->items,
+				size * sizeof(struct diagnostic));
+		if(!items)
+			return;
+		diags->items = items;
+		diags->size = size;
+	}
+
+	va_list copy;
+	va_copy(copy, args);
+	int len = vsnprintf(0, 0, fmt, copy);
+	va_end(copy);
+	char *msg = (char *) malloc(len + 1);
+	if(!msg)
+		return;
+	vsnprintf(msg, len + 1, fmt, args);
+
+	char *src = 0;
+	if(show_src){
+		const char *s;
+		size_t slen = trimmed_line(&prog->src, &s);
+		if( (src = (char *) malloc(slen + 1)) ){
+			memcpy(src, s, slen);
+			src[slen] = '\0';
+		}
+	}
+
+	struct diagnostic *d = &diags->items[diags->count++];
+	d->severity = severity;
+	d->code = code;
+	d->line = line;
+	d->msg = msg;
+	d->src = src;
+}
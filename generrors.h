@@ -1,17 +1,62 @@
 #ifndef _GENERRORS_H_
 #define _GENERRORS_H_
 
+#include <stddef.h>
+
 // Instruction Processing Return Codes
 #define GARBAGE		1
 #define SYM_ERR		2
 #define ALLOC_ERR	3
 #define FAULT		4
 
+// Diagnostic Severities
+#define DIAG_ERROR		0
+#define DIAG_WARNING	1
+
+// Diagnostic Lines
+#define NO_LINE		-1	// the diagnostic is about the input as a whole
+
+/**
+ * diagnostic
+ * short severity		DIAG_ERROR or DIAG_WARNING
+ * short code			The error code the problem set, 0 for warnings
+ * int line				The line (or position) it refers to, or NO_LINE
+ * char *msg			The message, without any decoration
+ * char *src			The offending source line (trimmed), or 0
+ */
+struct diagnostic{
+	short severity;
+	short code;
+	int line;
+	char *msg;
+	char *src;
+};
+
+/**
+ * diag_list
+ * When a program has one of these, diagnostics are collected into it rather
+ * than printed. All of it is malloc'd and outlives the translation.
+ *
+ * struct diagnostic *items		The diagnostics, in the order they were made
+ * size_t count					The number of diagnostics
+ * size_t size					The allocated size of items
+ */
+struct diag_list{
+	struct diagnostic *items;
+	size_t count;
+	size_t size;
+};
+
 struct program;
 
+// Reporting of problems in the input
+void report_error(struct program *prog, short code, const char *fmt, ...);
+void report_at(struct program *prog, short severity, short code, int line,
+		const char *fmt, ...);
+void free_diagnostics(struct diag_list *diags);
+
 // Compiler Errors generated by the compiler itself
 void print_memory_error(struct program *prog);
 void print_fault(const char *reason, struct program *prog);
 
 #endif
-
@@ -0,0 +1,103 @@
+/**
+* File: hartz.c
+* Author: Grant Kurtz
+*
+* Description: Command line front end of the Hartz translator. All of the
+* translation itself lives in translator.c, so that it can be linked into
+* other programs (such as the test suite) as well.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "symbols.h"
+#include "idents.h"
+#include "strlib.h"
+#include "opcodes.h"
+#include "trace.h"
+
+int main(int argc, char **argv){
+
+	// perform sanity check on arguments
+	if(argc < 3 || argc > 3 + FLAG_CNT){
+		print_help(argv[0]);
+		return 1;
+	}
+
+	// traces asked for in the environment, -T adds to them
+	const char *spec = getenv(TRACE_ENV);
+	if(trace_setup(spec)){
+		print_asterisk(YLW_C, stderr);
+		fprintf(stderr, "Warning: Unknown trace in %s='%s'.\n", TRACE_ENV,
+				spec);
+	}
+
+	// process argument options
+	struct options opts;
+	int workers = 0;
+	memset(&opts, 0, sizeof(struct options));
+	opts.out_format = OUT_TEXT;
+	int c = 3;
+	while(c < argc){
+		if(strcmp(argv[c], WARN_FLAG) == 0)
+			opts.warnings = 1;
+		else if(strcmp(argv[c], SYST_FLAG) == 0)
+			opts.print_tables = 1;
+		else if(strcmp(argv[c], COMP_INFO) == 0)
+			opts.print_comp_i = 1;
+		else if(strcmp(argv[c], HELP_FLAG) == 0)
+			print_help(argv[0]);
+		else if(strcmp(argv[c], FAST_FLAG) == 0)
+			opts.make_fast = 1;
+		else if(strcmp(argv[c], ATOM_FLAG) == 0)
+			opts.atomic_out = 1;
+		else if(strcmp(argv[c], BYTE_FLAG) == 0)
+			opts.out_format = OUT_BYTES;
+		else if(strcmp(argv[c], PACK_FLAG) == 0)
+			opts.out_format = OUT_PACKED;
+		else if(strcmp(argv[c], OPT_FLAG) == 0)
+			opts.optimize = 1;
+		else if(strcmp(argv[c], TIME_FLAG) == 0)
+			opts.timings = 1;
+		else if(strcmp(argv[c], TRACE_FLAG) == 0 && c + 1 < argc &&
+				!trace_setup(argv[c+1]))
+			c++;
+		else if(strcmp(argv[c], JOBS_FLAG) == 0 && c + 1 < argc &&
+				(workers = atoi(argv[c+1])) > 0)
+			c++;
+		else{
+			print_asterisk(RED_C, stderr);
+			fprintf(stderr, "Unknown flag '%s'.\n\n", argv[c]);
+			print_help(argv[0]);
+			return 1;
+		}
+		c++;
+	}
+
+	// print banner
+	if(opts.print_comp_i){
+		printf( "\t\t=== Hartz Translator ===\n"
+				"Machine Constraints\n"
+				"\t%d Bytes of Memory\n"
+				"\t%d Registers\n"
+				"\t%d Bytes of Cache\n\n"
+				"Compiler Constraints\n"
+				"\tMax One Instruction Per Line\n\n",
+				MAX_MEMORY, MAX_REGS, MAX_CACHE);
+	}
+
+	// operand formats only need compiling once, before any workers start
+	if(compile_formats()){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Malformed instruction format.\n");
+		return 4;
+	}
+
+	if(strcmp(argv[1], BATCH_FLAG) == 0)
+		return translate_batch(argv[2], workers, &opts);
+
+	if(translate_file(argv[1], argv[2], &opts) == 2)
+		return 2;
+	return 0;
+}
@@ -13,6 +13,8 @@
 #include "generrors.h"
 #include "strlib.h"
 #include "symbols.h"
+#include "fixups.h"
+#include "trace.h"
 
 short check_label_def(char *tok, struct program *prog){
 	if(tok[strlen(tok)-1] == LABEL_SYM)
@@ -27,22 +29,17 @@ void process_comment(struct program *prog){
 }
 
 void process_label_def(char *tok, struct program *prog){
-	#ifdef DEBUG
-		fprintf(stderr, "Procesing label on line %d\n",
-				prog->line_count);
-	#endif
+	TRACE(prog, TRACE_SYMBOL, TRACE_LINE, "label '%s' at position %d", tok,
+			prog->terms.count);
 
 	struct symbol *s;
 
 	if(tok[0] == LABEL_SYM){
-		print_compiler_error(prog, RED_C);
-		print_asterisk(RED_C, stderr);
-		fprintf(stderr, "Label definition is empty!\n");
-		prog->error_code = EMPTY_DEF;
+		report_error(prog, EMPTY_DEF, "Label definition is empty!");
 	}
 	else{
-		char *iden = (char *) malloc(sizeof(tok));
-		strcpy(iden, tok);
+		// strip the label symbol, the symbol table keeps its own copy
+		char *iden = tok;
 		iden[strlen(iden)-1] = '\0';
 		if( (s = find_symbol(iden, prog->tbl)) ){
 			
@@ -52,29 +49,25 @@ void process_label_def(char *tok, struct program *prog){
 
 				// Gah! The fucntion was already claimed elsewhere!
 				if(s->pos != -1){
-					print_compiler_error(prog, RED_C);
-					print_asterisk(RED_C, stderr);
-					fprintf(stderr, "Function was already defined on line "
-							"%d!\n", s->pos);
-					prog->error_code = FUNC_DOUBLE;
+					report_error(prog, FUNC_DOUBLE, "Function was already "
+							"defined on line %d!", s->pos);
 				}
 				else{
 					// giving the function a location
-					s->pos = prog->term_count;
+					s->pos = prog->terms.count;
+					fix_symbol(s, prog);
 				}
 			}
 			else{
-				print_compiler_error(prog, RED_C);
-				print_asterisk(RED_C, stderr);
-				fprintf(stderr, "Doubly defined label!\n");
-				prog->error_code = DOUBLE_DEF;
+				report_error(prog, DOUBLE_DEF, "Doubly defined label!");
 			}
 		}
 
 		// Just a plain label
 		else{
-			add_symbol(iden, prog->line_count, prog->tbl, prog->term_count,
+			add_symbol(iden, prog->line_count, prog->tbl, prog->terms.count,
 					LABEL_TYPE);
+			fix_symbol(prog->tbl->e, prog);
 		}
 	}
 }
@@ -87,27 +80,17 @@ short check_const_def(char *tok, struct program *prog){
 
 void process_const_def(char *tok, struct program *prog){
 	if(!tok[1]){
-		print_compiler_error(prog, RED_C);
-		print_asterisk(RED_C, stderr);
-		fprintf(stderr, "Defined constant is empty!\n");
-		prog->error_code = EMPTY_DEF;
+		report_error(prog, EMPTY_DEF, "Defined constant is empty!");
 	}
 	else{
-		char *iden = (char *) malloc(sizeof(tok)-1);
-		strcpy(iden, tok+1);
+		char *iden = tok+1;
 		if(find_symbol(iden, prog->const_tbl)){
-			print_compiler_error(prog, RED_C);
-			print_asterisk(RED_C, stderr);
-			fprintf(stderr, "Doubly defined constant!\n");
-			prog->error_code = DOUBLE_DEF;
+			report_error(prog, DOUBLE_DEF, "Doubly defined constant!");
 		}
 		else{
-			tok = strtok(0, STR_TOK_SEP);
+			tok = next_token(&prog->src, STR_TOK_SEP);
 			if(!tok){
-				print_compiler_error(prog, RED_C);
-				print_asterisk(RED_C, stderr);
-				fprintf(stderr, "Newly defined constant has no value!\n");
-				prog->error_code = NO_DEF_VAL;
+				report_error(prog, NO_DEF_VAL, "Newly defined constant has no value!");
 			}
 			else{
 				// TODO: CHECK VALUE OF ATOI() call
@@ -129,9 +112,7 @@ short check_const(char *tok, struct program *prog){
 }
 
 short check_explicit_literal(char *tok, struct program *prog){
-	#ifdef DEBUG
-		fprintf(stderr, "CHECKING TOK: '%s'\n", tok);
-	#endif
+	TRACE(prog, TRACE_PARSE, TRACE_TERM, "literal? '%s'", tok);
 	if(tok[0] == LITERAL_SYM)
 		return 1;
 	return 0;
@@ -145,7 +126,7 @@ int process_literal(char *tok, int max_val){
 void blind_consume(struct program *prog){
 	char * buf;
 	while(1){
-		buf = strtok(0, ", \t\n");
+		buf = next_token(&prog->src, ", \t\n");
 		if(!buf)
 			break;
 	}
@@ -163,19 +144,16 @@ short check_comment(char * tok, struct program * prog){
  * failure and the line the failure occured on.
  */
 void print_compiler_error(struct program *prog, const char *color){
-	char buf[MAX_LINE_LEN+1];
-	buf[MAX_LINE_LEN] = 0;
 	if(color)
-		print_asterisk(color, stderr);
-	fprintf(stderr, "%s, %d:\n", prog->input, prog->line_count);
+		print_asterisk(color, prog->err);
+	fprintf(prog->err, "%s, %u:\n", prog->input, prog->line_count);
 	
-	// Go back to start of line to show the user where the error occurred.
-	fsetpos(prog->in, &prog->str_line);
-	fgets(buf, MAX_LINE_LEN, prog->in);
-	trimwhitespace(buf);
+	// Show the user the (untouched) line where the error occurred.
+	const char *line;
+	int len = (int) trimmed_line(&prog->src, &line);
 	if(color)
-		print_asterisk(color, stderr);
-	fprintf(stderr, "\t'%s'\n", buf);
+		print_asterisk(color, prog->err);
+	fprintf(prog->err, "\t'%.*s'\n", len, line);
 }
 
 /**
@@ -183,10 +161,7 @@ void print_compiler_error(struct program *prog, const char *color){
  * anticipated, that wasnot supposed to exist.
  */
 void print_unexpected_ident(char *ident, struct program *prog){
-	print_compiler_error(prog, RED_C);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tUnexpected Identifier '%s'.\n", ident);
-	prog->error_code = GARBAGE;
+	report_error(prog, GARBAGE, "Unexpected Identifier '%s'.", ident);
 }
 
 /**
@@ -194,10 +169,7 @@ void print_unexpected_ident(char *ident, struct program *prog){
  * unexpected character was read where another was anticipated.
  */
 void print_expected_ident(char *ident, char *expected, struct program *prog){
-	print_compiler_error(prog, RED_C);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tExpected '%s' but found '%s'.\n", expected, ident);
-	prog->error_code = GARBAGE;
+	report_error(prog, GARBAGE, "Expected '%s' but found '%s'.", expected, ident);
 }
 
 void print_asterisk(const char *color, FILE *out){
@@ -212,20 +184,12 @@ void process_func_def(char *tok, struct program *prog){
 	
 	// Check for empty definitions
 	if(strlen(tok) == 1){
-		print_compiler_error(prog, RED_C);
-		print_asterisk(RED_C, stderr);
-		fprintf(stderr, "\tFunction Definition is empty!\n");
-		prog->error_code = EMPTY_DEF;
+		report_error(prog, EMPTY_DEF, "Function Definition is empty!");
 	}
 	else{
-		char *iden = (char *) malloc(sizeof(tok) + 1);
-		strcpy(iden, tok + 1);
-		iden[strlen(iden)] = '\0';
+		char *iden = tok + 1;
 		if(find_symbol(iden, prog->tbl)){
-			print_compiler_error(prog, RED_C);
-			print_asterisk(RED_C, stderr);
-			fprintf(stderr, "\tFunction already defined!\n");
-			prog->error_code = DOUBLE_DEF;
+			report_error(prog, DOUBLE_DEF, "Function already defined!");
 		}
 		else{
 			add_symbol(iden, -1, prog->tbl, -1, FUNC_TYPE);
@@ -234,24 +198,15 @@ void process_func_def(char *tok, struct program *prog){
 }
 
 void print_literal_too_large(char *iden, struct program *prog){
-	print_compiler_error(prog, RED_C);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tThe literal '%s' is too large to represent!\n", iden);
-	prog->error_code = LIT_TOO_BIG;
+	report_error(prog, LIT_TOO_BIG, "The literal '%s' is too large to represent!", iden);
 }
 
 void print_expected_literal(char *iden, struct program *prog){
-	print_compiler_error(prog, RED_C);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tExpected a literal, not '%s'!\n", iden);
-	prog->error_code = UNEXPECTED;
+	report_error(prog, UNEXPECTED, "Expected a literal, not '%s'!", iden);
 }
 
 void print_expected_const(char *iden, struct program *prog){
-	print_compiler_error(prog, RED_C);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tExpected a constant definiton, not '%s'!\n", iden);
-	prog->error_code = UNEXPECTED;
+	report_error(prog, UNEXPECTED, "Expected a constant definiton, not '%s'!", iden);
 }
 
 
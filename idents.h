@@ -8,9 +8,6 @@
 #define LITERAL_SYM		'!'
 #define FUNC_DEF		'.'
 
-// Soft Contraints
-#define MAX_LINE_LEN	32
-
 // Error Reporting
 #define	DOUBLE_DEF		30
 #define	NO_DEF_VAL		31
@@ -57,7 +54,7 @@ short check_func_def(char *tok, struct program *prog);
 void process_func_def(char *tok, struct program *prog);
 
 // Miscellaneous
-void blind_consume();
+void blind_consume(struct program *prog);
 
 #endif
 
@@ -0,0 +1,130 @@
+/**
+ * File:		image.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Reads and writes binary program images, a small fixed header
+ * 				followed by the encoded words, so that loaders don't need to
+ * 				parse the text output of the translator.
+ */
+
+#include <string.h>
+#include "image.h"
+
+/**
+ * @param	count		The number of words.
+ * @param	word_size	Bits per word.
+ * @param	encoding	IMG_BYTES or IMG_PACKED.
+ * @return				The size in bytes of the image, header included.
+ */
+size_t image_size(size_t count, int word_size, int encoding){
+	if(encoding == IMG_PACKED)
+		return IMG_HEADER_SIZE + (count * word_size + 7) / 8;
+	return IMG_HEADER_SIZE + count;
+}
+
+/**
+ * Writes an image of the given words into buf, which must hold at least
+ * image_size() bytes.
+ *
+ * @param	buf			Where to write the image.
+ * @param	words		The words of the program, in text ring order.
+ * @param	count		The number of words.
+ * @param	word_size	Bits per word.
+ * @param	ring_size	The size of the text ring the program is for.
+ * @param	encoding	IMG_BYTES or IMG_PACKED.
+ * @return				The number of bytes written.
+ */
+size_t write_image(char *buf, const unsigned char *words, size_t count, 
+		int word_size, int ring_size, int encoding){
+	unsigned char *b = (unsigned char *) buf;
+	size_t size = image_size(count, word_size, encoding);
+	size_t i;
+
+	memcpy(b, IMG_MAGIC, 4);
+	b[4] = IMG_VERSION;
+	b[5] = word_size;
+	b[6] = encoding;
+	b[7] = ring_size;
+	for(i = 0; i < 4; i++)
+		b[8 + i] = (count >> (8 * i)) & 0xFF;
+	b += IMG_HEADER_SIZE;
+
+	unsigned char mask = (1 << word_size) - 1;
+	if(encoding != IMG_PACKED){
+		for(i = 0; i < count; i++)
+			b[i] = words[i] & mask;
+		return size;
+	}
+
+	// shift each word into an accumulator and flush whole bytes
+	unsigned int acc = 0;
+	int bits = 0;
+	memset(b, 0, size - IMG_HEADER_SIZE);
+	for(i = 0; i < count; i++){
+		acc = (acc << word_size) | (words[i] & mask);
+		bits += word_size;
+		while(bits >= 8){
+			bits -= 8;
+			*b++ = (acc >> bits) & 0xFF;
+		}
+	}
+	if(bits)
+		*b = (acc << (8 - bits)) & 0xFF;
+	return size;
+}
+
+/**
+ * Validates an image and decodes its words.
+ *
+ * @param	buf			The image.
+ * @param	len			The size of the image in bytes.
+ * @param	hdr			Filled with the header of the image.
+ * @param	words		Where to decode the words, may be 0 to only read
+ * 						the header.
+ * @param	max_words	The number of words that fit in words.
+ * @return				The number of words decoded, otherwise one of the
+ * 						IMG_* error codes.
+ */
+long read_image(const char *buf, size_t len, struct image_header *hdr, 
+		unsigned char *words, size_t max_words){
+	const unsigned char *b = (const unsigned char *) buf;
+	size_t i;
+
+	if(len < IMG_HEADER_SIZE || memcmp(b, IMG_MAGIC, 4))
+		return IMG_BAD_MAGIC;
+	hdr->version = b[4];
+	hdr->word_size = b[5];
+	hdr->encoding = b[6];
+	hdr->ring_size = b[7];
+	hdr->word_count = 0;
+	for(i = 0; i < 4; i++)
+		hdr->word_count |= (unsigned long) b[8 + i] << (8 * i);
+	if(hdr->version != IMG_VERSION || !hdr->word_size || hdr->word_size > 8
+			|| (hdr->encoding != IMG_BYTES && hdr->encoding != IMG_PACKED))
+		return IMG_BAD_HEADER;
+	if(len < image_size(hdr->word_count, hdr->word_size, hdr->encoding))
+		return IMG_TRUNCATED;
+	if(!words)
+		return 0;
+
+	size_t count = hdr->word_count < max_words ? hdr->word_count : max_words;
+	unsigned char mask = (1 << hdr->word_size) - 1;
+	b += IMG_HEADER_SIZE;
+	if(hdr->encoding != IMG_PACKED){
+		for(i = 0; i < count; i++)
+			words[i] = b[i] & mask;
+		return count;
+	}
+
+	unsigned int acc = 0;
+	int bits = 0;
+	for(i = 0; i < count; i++){
+		while(bits < hdr->word_size){
+			acc = (acc << 8) | *b++;
+			bits += 8;
+		}
+		bits -= hdr->word_size;
+		words[i] = (acc >> bits) & mask;
+	}
+	return count;
+}
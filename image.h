@@ -0,0 +1,52 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+
+// Image Header Layout
+// 	offset 	size 	field
+// 	0 		4 		magic, IMG_MAGIC
+// 	4 		1 		format version, IMG_VERSION
+// 	5 		1 		bits per word
+// 	6 		1 		word encoding, IMG_BYTES or IMG_PACKED
+// 	7 		1 		text ring size in words
+// 	8 		4 		word count, little endian
+#define IMG_MAGIC		"HRTZ"
+#define IMG_VERSION		1
+#define IMG_HEADER_SIZE	12
+
+// Word Encodings
+#define IMG_BYTES		0	// one word per byte, in the low bits
+#define IMG_PACKED		1	// words back to back, most significant bit first
+
+// Image Errors
+#define IMG_BAD_MAGIC	-1
+#define IMG_BAD_HEADER	-2
+#define IMG_TRUNCATED	-3
+
+/**
+ * image_header
+ * unsigned char version		The format version of the image
+ * unsigned char word_size		Bits per word
+ * unsigned char encoding		How the words are stored, IMG_BYTES/IMG_PACKED
+ * unsigned char ring_size		The size of the text ring the image is for
+ * unsigned long word_count		The number of words in the image
+ */
+struct image_header{
+	unsigned char version;
+	unsigned char word_size;
+	unsigned char encoding;
+	unsigned char ring_size;
+	unsigned long word_count;
+};
+
+// Image Writing
+size_t image_size(size_t count, int word_size, int encoding);
+size_t write_image(char *buf, const unsigned char *words, size_t count, 
+		int word_size, int ring_size, int encoding);
+
+// Image Reading
+long read_image(const char *buf, size_t len, struct image_header *hdr, 
+		unsigned char *words, size_t max_words);
+
+#endif
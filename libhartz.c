@@ -0,0 +1,93 @@
+/**
+* File: libhartz.c
+* Author: Grant Kurtz
+*
+* Description: The translator as an embeddable library. A translation takes
+* its input from a buffer and hands back the encoded words and a list of
+* diagnostics; nothing is read from or written to any file, and nothing is
+* printed, so any number of translations may run at once.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "libhartz.h"
+#include "translator.h"
+#include "symbols.h"
+#include "opcodes.h"
+
+static pthread_once_t formats_once = PTHREAD_ONCE_INIT;
+static int formats_status;
+
+static void init_formats(){
+	formats_status = compile_formats();
+}
+
+/**
+* Translates a Hartz assembly program held in memory.
+*
+* @param input 		The Hartz assembly source.
+* @param size 		The number of bytes in input.
+* @param opts 		The options to translate with, or 0 for the defaults.
+* @param res 		Filled in with the words and diagnostics, must be
+* 					released with hartz_free_result() afterwards.
+* @return 			0 on success, otherwise the error code of the
+* 					translation (also in res->error_code).
+*/
+int hartz_translate(const char *input, size_t size, 
+		const struct hartz_options *opts, struct hartz_result *res){
+	memset(res, 0, sizeof(struct hartz_result));
+	pthread_once(&formats_once, init_formats);
+	if(formats_status)
+		return res->error_code = FAULT;
+
+	// no output file and no streams, the program keeps everything itself
+	struct program program;
+	struct symbol_table tbl;
+	struct symbol_table const_tbl;
+	struct diag_list diags;
+	memset(&program, 0, sizeof(struct program));
+	memset(&tbl, 0, sizeof(struct symbol_table));
+	memset(&const_tbl, 0, sizeof(struct symbol_table));
+	memset(&diags, 0, sizeof(struct diag_list));
+	program.opts.out_format = OUT_TEXT;
+	program.opts.quiet = 1;
+	if(opts){
+		program.opts.warnings = opts->warnings;
+		program.opts.make_fast = opts->make_fast;
+		program.opts.optimize = opts->optimize;
+	}
+	program.input = "";
+	program.tbl = &tbl;
+	program.const_tbl = &const_tbl;
+	program.diags = &diags;
+	open_source_buffer(&program.src, input, size);
+
+	run_translation(&program);
+
+	// a failed translation may have written part of an image
+	if(program.error_code){
+		free(program.image);
+		program.image = 0;
+		program.image_len = 0;
+	}
+	res->words = program.image;
+	res->word_count = program.image_len;
+	res->diags = diags.items;
+	res->diag_count = diags.count;
+	return res->error_code = program.error_code;
+}
+
+/**
+* Releases everything a hartz_translate() result holds.
+*/
+void hartz_free_result(struct hartz_result *res){
+	struct diag_list diags;
+	diags.items = res->diags;
+	diags.count = res->diag_count;
+	diags.size = res->diag_count;
+	free_diagnostics(&diags);
+	free(res->words);
+	memset(res, 0, sizeof(struct hartz_result));
+}
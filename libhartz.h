@@ -0,0 +1,48 @@
+#ifndef LIBHARTZ_H
+#define LIBHARTZ_H
+
+#include <stddef.h>
+#include "generrors.h"
+
+/**
+ * hartz_options
+ * The settings of a library translation, the same as the command line flags
+ * of the same name.
+ *
+ * short warnings		Report unused labels and constants (-w)
+ * short make_fast		Make Code Faster (TM) (-f)
+ * short optimize		Shorten the program with a peephole pass (-O)
+ */
+struct hartz_options{
+	short warnings;
+	short make_fast;
+	short optimize;
+};
+
+/**
+ * hartz_result
+ * The outcome of hartz_translate(). Everything in it is malloc'd and is
+ * released with hartz_free_result().
+ *
+ * unsigned char *words		The encoded program, one word per byte, or 0 if
+ * 							the translation failed
+ * size_t word_count		The number of words
+ * struct diagnostic *diags	Every error and warning, in the order found
+ * size_t diag_count		The number of diagnostics
+ * int error_code			0 on success, otherwise the code of the error
+ * 							that stopped the translation
+ */
+struct hartz_result{
+	unsigned char *words;
+	size_t word_count;
+	struct diagnostic *diags;
+	size_t diag_count;
+	int error_code;
+};
+
+// Translation
+int hartz_translate(const char *input, size_t size, 
+		const struct hartz_options *opts, struct hartz_result *res);
+void hartz_free_result(struct hartz_result *res);
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * File:		machine.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Simulates the Hartz machine one instruction at a time, counting
+ * 				the cycles spent. Each step loads the word under the text
+ * 				ring's head, rotates the text ring once and executes it.
+ * 				Operand words are read (and rotated past) the same way, so a
+ * 				jump rotates from the word after its last operand.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "image.h"
+#include "source.h"
+
+static unsigned char fetch(struct machine *m);
+static void jump(struct machine *m, unsigned char amount);
+static void rotate_data(struct machine *m, unsigned char amount);
+
+/**
+ * Clears the machine, the text ring included, and puts both heads at the
+ * start of their rings.
+ */
+void reset_machine(struct machine *m){
+	memset(m, 0, sizeof(struct machine));
+	m->fault_pos = -1;
+}
+
+/**
+ * Loads translator output onto the text ring, with the first word under the
+ * head. Both the text output (one line of bits per word) and binary images
+ * are read; any words the program doesn't use are left zero.
+ *
+ * @param	m		The machine to load, its data ring and registers are
+ * 					left untouched.
+ * @param	buf		The translator output.
+ * @param	len		The size of buf in bytes.
+ * @return			The number of words loaded, otherwise one of the LOAD_*
+ * 					errors.
+ */
+int load_program(struct machine *m, const char *buf, size_t len){
+	struct image_header hdr;
+	unsigned char words[MAX_MEMORY];
+	long count = read_image(buf, len, &hdr, words, MAX_MEMORY);
+	if(count >= 0){
+		if(hdr.word_size != WORD_SIZE || hdr.word_count > MAX_MEMORY)
+			return hdr.word_count > MAX_MEMORY ? LOAD_TOO_BIG : LOAD_BAD_IMAGE;
+	}
+	else if(count != IMG_BAD_MAGIC)
+		return LOAD_BAD_IMAGE;
+	else{
+
+		// not an image, so the text output
+		struct source src;
+		const char *s;
+		size_t n, i;
+		open_source_buffer(&src, buf, len);
+		count = 0;
+		while(next_line(&src)){
+			if(!(n = trimmed_line(&src, &s)))
+				continue;
+			if(n != WORD_SIZE)
+				return LOAD_BAD_WORD;
+			if(count == MAX_MEMORY)
+				return LOAD_TOO_BIG;
+			words[count] = 0;
+			for(i = 0; i < n; i++){
+				if(s[i] != '0' && s[i] != '1')
+					return LOAD_BAD_WORD;
+				words[count] = (words[count] << 1) | (s[i] - '0');
+			}
+			count++;
+		}
+		close_source(&src);
+	}
+
+	load_words(m, words, count);
+	return count;
+}
+
+/**
+ * Puts already decoded words onto the text ring, see load_program().
+ *
+ * @param	m		The machine to load.
+ * @param	words	The words of the program, at most MAX_MEMORY of them.
+ * @param	count	The number of words.
+ */
+void load_words(struct machine *m, const unsigned char *words, size_t count){
+	memset(m->text, 0, sizeof(m->text));
+	memcpy(m->text, words, count);
+	m->tp = 0;
+}
+
+/**
+ * Finds the instruction a word encodes. The 7 bit codes are checked first,
+ * then the shorter ones by prefix, so that a full code is never mistaken for
+ * a shorter code with operand bits (which matters for LROT, whose code is
+ * also what ROT $S2 would encode to).
+ *
+ * @param	word	The word to decode.
+ * @return			The index of the instruction in the opcode table,
+ * 					SIM_LJMP, or -1 if the word isn't an instruction.
+ */
+int decode_word(unsigned char word){
+	int best = -1, best_len = 0, i;
+	for(i = 0; i < OPCODE_CNT; i++){
+		int shift = WORD_SIZE - opcodes[i].len;
+		if(opcodes[i].len > best_len &&
+				(word >> shift) == (opcodes[i].code >> shift)){
+			best = i;
+			best_len = opcodes[i].len;
+		}
+	}
+	if(LJMP_L > best_len &&
+			(word >> (WORD_SIZE - LJMP_L)) == (LJMP >> (WORD_SIZE - LJMP_L)))
+		best = SIM_LJMP;
+	return best;
+}
+
+/**
+ * @return			The mnemonic of a decoded instruction.
+ */
+const char *op_name(int op){
+	if(op == SIM_LJMP)
+		return "LJMP";
+	return op >= 0 && op < OPCODE_CNT ? opcodes[op].name : "???";
+}
+
+/**
+ * Executes the instruction under the text ring's head.
+ *
+ * @param	m		The machine to step.
+ * @return			RUN_HALTED once the machine has halted, RUN_ILLEGAL if
+ * 					the word fetched isn't an instruction, otherwise -1.
+ */
+int step_machine(struct machine *m){
+	if(m->halted)
+		return RUN_HALTED;
+
+	int pos = m->tp;
+	unsigned char word = fetch(m);
+	int op = decode_word(word);
+	if(op < 0){
+		m->fault_pos = pos;
+		return RUN_ILLEGAL;
+	}
+	m->counts[op]++;
+	m->executed++;
+
+	// operand bits follow the code: registers one bit each, $1 is 0
+	unsigned char *r = m->regs;
+	int len = op == SIM_LJMP ? LJMP_L : opcodes[op].len;
+	int a = len < WORD_SIZE ? (word >> (WORD_SIZE - len - 1)) & 1 : 0;
+	int b = len < WORD_SIZE - 1 ? (word >> (WORD_SIZE - len - 2)) & 1 : 0;
+	int c = len < WORD_SIZE - 2 ? (word >> (WORD_SIZE - len - 3)) & 1 : 0;
+	unsigned char v;
+
+	switch(op){
+		case OP_NOT:	r[b] = ~r[a] & WORD_MASK; break;
+		case OP_SHL:	r[b] = (r[a] << 1) & WORD_MASK; break;
+		case OP_SHR:	r[b] = r[a] >> 1; break;
+		case OP_OR:		r[c] = r[a] | r[b]; break;
+		case OP_AND:	r[c] = r[a] & r[b]; break;
+		case OP_ADD:	r[c] = (r[a] + r[b]) & WORD_MASK; break;
+		case OP_SW:		m->data[m->dp] = r[a]; break;
+		case OP_SI:		m->data[m->dp] = fetch(m); break;
+		case OP_LW:		r[a] = m->data[m->dp]; break;
+
+		// there is no register operand, the zero bit selects $1
+		case OP_LI:		r[a] = fetch(m); break;
+
+		case OP_BEZ:
+			v = fetch(m);
+			if(!r[a])
+				jump(m, v);
+			break;
+		case OP_ROT:	rotate_data(m, r[a]); break;
+		case OP_ROT1:	rotate_data(m, 1); break;
+		case OP_LROT:	rotate_data(m, fetch(m)); break;
+		case OP_JMP:	jump(m, fetch(m)); break;
+		case OP_HALT:	m->halted = 1; return RUN_HALTED;
+		case OP_NOP:	break;
+
+		// return: jump by the next text word less the word on the data ring
+		case OP_LFSJ:
+			v = fetch(m);
+			m->jump = (v - m->data[m->dp]) & WORD_MASK;
+			jump(m, m->jump);
+			break;
+
+		// call: save the return word to the data ring, jump by the next
+		case OP_STJ:
+			m->data[m->dp] = fetch(m);
+			m->jump = fetch(m);
+			jump(m, m->jump);
+			break;
+
+		// the multiplier is the operand bits of the LJMP word itself
+		case SIM_LJMP:	m->mult = word & ((1 << (WORD_SIZE - LJMP_L)) - 1);
+						break;
+	}
+	return -1;
+}
+
+/**
+ * Runs the machine until it halts, faults or uses up the cycle limit.
+ *
+ * @param	m			The machine to run.
+ * @param	max_cycles	The most cycles to run for, 0 for no limit.
+ * @return				RUN_HALTED, RUN_ILLEGAL or RUN_LIMIT.
+ */
+int run_machine(struct machine *m, unsigned long max_cycles){
+	int ret;
+	while(!max_cycles || m->cycles < max_cycles){
+		if((ret = step_machine(m)) >= 0)
+			return ret;
+	}
+	return RUN_LIMIT;
+}
+
+/**
+ * Reads the word under the text ring's head and rotates past it.
+ */
+static unsigned char fetch(struct machine *m){
+	unsigned char word = m->text[m->tp];
+	m->tp = (m->tp + 1) % MAX_MEMORY;
+	m->cycles += CYC_WORD;
+	return word;
+}
+
+/**
+ * Rotates the text ring, applying (and clearing) any pending LJMP multiplier.
+ */
+static void jump(struct machine *m, unsigned char amount){
+	int steps = amount;
+	if(m->mult){
+		steps *= m->mult;
+		m->mult = 0;
+	}
+	steps %= MAX_MEMORY;
+	m->tp = (m->tp + steps) % MAX_MEMORY;
+	m->cycles += steps * CYC_STEP;
+}
+
+/**
+ * Rotates the data ring.
+ */
+static void rotate_data(struct machine *m, unsigned char amount){
+	int steps = amount % MAX_CACHE;
+	m->dp = (m->dp + steps) % MAX_CACHE;
+	m->cycles += steps * CYC_STEP;
+}
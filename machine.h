@@ -0,0 +1,73 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stddef.h>
+
+// Machine Run Results
+#define RUN_HALTED		0	// a HALT was executed
+#define RUN_LIMIT		1	// the cycle limit was reached first
+#define RUN_ILLEGAL		2	// a word that isn't an instruction was fetched
+#define RUN_LOOP		3	// a state repeated, so it never halts (states.c)
+#define RUN_NO_MEMORY	4	// the states seen couldn't all be kept (states.c)
+
+// Loading Errors
+#define LOAD_BAD_WORD	-1	// a text line isn't WORD_SIZE '0'/'1' characters
+#define LOAD_TOO_BIG	-2	// the program doesn't fit on the text ring
+#define LOAD_BAD_IMAGE	-3	// the binary image is damaged or for another machine
+
+// Instruction Counters
+#define SIM_LJMP		OPCODE_CNT		// LJMP has no entry in the opcode table
+#define SIM_OPS			(OPCODE_CNT + 1)
+
+// Cycle Costs
+// Every word read off the text ring (instruction or operand) rotates the ring
+// once and costs CYC_WORD. Jumps rotate the text ring, and ROT/ROT1/LROT the
+// data ring, one position per CYC_STEP; rotations are taken modulo the size
+// of the ring, since a full turn ends where it started.
+#define CYC_WORD		1
+#define CYC_STEP		1
+
+/**
+ * machine
+ * The complete state of a Hartz machine, see "Hartz Instruction Set.txt".
+ *
+ * unsigned char text[]		The text ring, holding the program
+ * int tp					Index of the word under the text ring's head
+ * unsigned char data[]		The data ring
+ * int dp					Index of the word under the data ring's head
+ * unsigned char regs[]		The registers, $1 and $2
+ * unsigned char jump		The jump register, last set by STJ/LFSJ
+ * unsigned char mult		Multiplier for the next jump set by LJMP, 0 if none
+ * int halted				Set once HALT was executed
+ * unsigned long cycles		Cycles spent so far
+ * unsigned long executed	Instructions executed so far
+ * unsigned long counts[]	Executions of each instruction, by opcode index
+ * int fault_pos			Text ring index of an illegal instruction
+ */
+struct machine{
+	unsigned char text[MAX_MEMORY];
+	int tp;
+	unsigned char data[MAX_CACHE];
+	int dp;
+	unsigned char regs[MAX_REGS];
+	unsigned char jump;
+	unsigned char mult;
+	int halted;
+	unsigned long cycles;
+	unsigned long executed;
+	unsigned long counts[SIM_OPS];
+	int fault_pos;
+};
+
+// Machine Setup
+void reset_machine(struct machine *m);
+int load_program(struct machine *m, const char *buf, size_t len);
+void load_words(struct machine *m, const unsigned char *words, size_t count);
+
+// Execution
+int decode_word(unsigned char word);
+const char *op_name(int op);
+int step_machine(struct machine *m);
+int run_machine(struct machine *m, unsigned long max_cycles);
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * File:		opcodes.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	The one table describing every Hartz instruction, shared by
+ * 				anything that needs to read or write machine code.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "opcodes.h"
+#include "translator.h"
+
+const struct opcode opcodes[OPCODE_CNT] = {
+	[OP_NOT]	= {"NOT",	NOT,	NOT_L,	NOT_F,	1},
+	[OP_SHL]	= {"SHL",	SHL,	SHL_L,	SHL_F,	1},
+	[OP_SHR]	= {"SHR",	SHR,	SHR_L,	SHR_F,	1},
+	[OP_OR]		= {"OR",	OR,		OR_L,	OR_F,	1},
+	[OP_AND]	= {"AND",	AND,	AND_L,	AND_F,	1},
+	[OP_ADD]	= {"ADD",	ADD,	ADD_L,	ADD_F,	1},
+	[OP_SW]		= {"SW",	SW,		SW_L,	SW_F,	1},
+	[OP_SI]		= {"SI",	SI,		SI_L,	SI_F,	2},
+	[OP_LW]		= {"LW",	LW,		LW_L,	LW_F,	1},
+	[OP_LI]		= {"LI",	LI,		LI_L,	LI_F,	2},
+	[OP_BEZ]	= {"BEZ",	BEZ,	BEZ_L,	BEZ_F,	2},
+	[OP_ROT]	= {"ROT",	ROT,	ROT_L,	ROT_F,	1},
+	[OP_ROT1]	= {"ROT1",	ROT1,	ROT1_L,	ROT1_F,	1},
+	[OP_LROT]	= {"LROT",	LROT,	LROT_L,	LROT_F,	2},
+	[OP_JMP]	= {"JMP",	JMP,	JMP_L,	JMP_F,	2},
+	[OP_HALT]	= {"HALT",	HALT,	HALT_L,	HALT_F,	1},
+	[OP_NOP]	= {"NOP",	NOP,	NOP_L,	NOP_F,	1},
+	[OP_LFSJ]	= {"LFSJ",	LFSJ,	LFSJ_L,	LFSJ_F,	2},
+	[OP_STJ]	= {"STJ",	STJ,	STJ_L,	STJ_F,	3},
+};
+
+// Compiled operand formats, parallel to the opcode table
+static struct operand_fmt formats[OPCODE_CNT];
+
+// Every word rendered as a bit string, most significant bit first
+const char word_strs[128][8] = {
+	"0000000", "0000001", "0000010", "0000011", "0000100", "0000101",
+	"0000110", "0000111", "0001000", "0001001", "0001010", "0001011",
+	"0001100", "0001101", "0001110", "0001111", "0010000", "0010001",
+	"0010010", "0010011", "0010100", "0010101", "0010110", "0010111",
+	"0011000", "0011001", "0011010", "0011011", "0011100", "0011101",
+	"0011110", "0011111", "0100000", "0100001", "0100010", "0100011",
+	"0100100", "0100101", "0100110", "0100111", "0101000", "0101001",
+	"0101010", "0101011", "0101100", "0101101", "0101110", "0101111",
+	"0110000", "0110001", "0110010", "0110011", "0110100", "0110101",
+	"0110110", "0110111", "0111000", "0111001", "0111010", "0111011",
+	"0111100", "0111101", "0111110", "0111111", "1000000", "1000001",
+	"1000010", "1000011", "1000100", "1000101", "1000110", "1000111",
+	"1001000", "1001001", "1001010", "1001011", "1001100", "1001101",
+	"1001110", "1001111", "1010000", "1010001", "1010010", "1010011",
+	"1010100", "1010101", "1010110", "1010111", "1011000", "1011001",
+	"1011010", "1011011", "1011100", "1011101", "1011110", "1011111",
+	"1100000", "1100001", "1100010", "1100011", "1100100", "1100101",
+	"1100110", "1100111", "1101000", "1101001", "1101010", "1101011",
+	"1101100", "1101101", "1101110", "1101111", "1110000", "1110001",
+	"1110010", "1110011", "1110100", "1110101", "1110110", "1110111",
+	"1111000", "1111001", "1111010", "1111011", "1111100", "1111101",
+	"1111110", "1111111"
+};
+
+/**
+ * Finds the table entry for a mnemonic. The length and leading characters
+ * pick the only possible candidate, so at most one strcmp is made.
+ *
+ * @param	tok		The (uppercase) mnemonic to look up.
+ * @return			The matching entry, otherwise 0.
+ */
+const struct opcode *find_opcode(const char *tok){
+	int i = -1;
+	switch(strlen(tok)){
+		case 2:
+			switch(tok[0]){
+				case 'O': i = OP_OR; break;
+				case 'S': i = tok[1] == 'W' ? OP_SW : OP_SI; break;
+				case 'L': i = tok[1] == 'W' ? OP_LW : OP_LI; break;
+			}
+			break;
+		case 3:
+			switch(tok[0]){
+				case 'N': i = tok[1] == 'O' && tok[2] == 'T' ? OP_NOT 
+						: OP_NOP; break;
+				case 'S': i = tok[1] == 'T' ? OP_STJ 
+						: tok[2] == 'L' ? OP_SHL : OP_SHR; break;
+				case 'A': i = tok[1] == 'N' ? OP_AND : OP_ADD; break;
+				case 'B': i = OP_BEZ; break;
+				case 'R': i = OP_ROT; break;
+				case 'J': i = OP_JMP; break;
+			}
+			break;
+		case 4:
+			switch(tok[0]){
+				case 'H': i = OP_HALT; break;
+				case 'R': i = OP_ROT1; break;
+				case 'L': i = tok[1] == 'F' ? OP_LFSJ : OP_LROT; break;
+			}
+			break;
+	}
+	if(i < 0 || strcmp(opcodes[i].name, tok))
+		return 0;
+	return &opcodes[i];
+}
+
+/**
+ * Compiles a format string into operand descriptors. The following format
+ * is accepted (strictly):
+ *
+ * 	s -> Source register
+ * 	d -> Destination register
+ * 	l -> Label
+ * 	c -> Constant
+ * 	n -> Literal number
+ * 	t -> Place an empty term after this term
+ * 	[ -> Start 'or' expression (non-recursive)
+ * 	] -> End 'or' expression
+ *
+ * Note that the or expression works as expected, so "[lcn]" translates to
+ * "take whichever successfully parses first, either a label, constant, or
+ * a number", and becomes a single operand with three alternatives.
+ *
+ * @param	fmt		The format string to compile.
+ * @param	out		Filled with the compiled operands.
+ * @return			0 on success, otherwise -1 if the format is malformed.
+ */
+int compile_format(const char *fmt, struct operand_fmt *out){
+	struct operand *o = 0;
+	short cls;
+	int or = 0;
+	memset(out, 0, sizeof(struct operand_fmt));
+	while(*fmt){
+		switch(*fmt){
+			case '[':
+				if(or || out->count == MAX_OPERANDS)
+					return -1;
+				or = 1;
+				o = &out->ops[out->count++];
+				fmt++;
+				continue;
+			case ']':
+				if(!or || !o->alt_count)
+					return -1;
+				or = 0;
+				fmt++;
+				continue;
+			case 's': cls = OPND_SRC; break;
+			case 'd': cls = OPND_DST; break;
+			case 'l': cls = OPND_LABEL; break;
+			case 'c': cls = OPND_CONST; break;
+			case 'n': cls = OPND_LIT; break;
+			case 't': cls = OPND_TERM; break;
+			default:
+				fprintf(stderr, " * Error In Compiler!!!\n\tStrange format "
+						"code: '%c'.\n", *fmt);
+				return -1;
+		}
+		if(!or){
+			if(out->count == MAX_OPERANDS)
+				return -1;
+			o = &out->ops[out->count++];
+		}
+		else if(o->alt_count == MAX_ALTS || cls == OPND_TERM)
+			return -1;
+		o->alts[o->alt_count++] = cls;
+		fmt++;
+	}
+	return or ? -1 : 0;
+}
+
+/**
+ * Compiles the format of every entry in the opcode table. This needs to be
+ * done once, before any instructions are processed.
+ *
+ * @return			0 on success, otherwise -1 if a format is malformed.
+ */
+int compile_formats(){
+	int i;
+	for(i = 0; i < OPCODE_CNT; i++){
+		if(compile_format(opcodes[i].fmt, &formats[i]))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * @return			The compiled operand format for the given table entry.
+ */
+const struct operand_fmt *opcode_format(const struct opcode *op){
+	return &formats[op - opcodes];
+}
@@ -0,0 +1,73 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+// Operand Classes
+#define OPND_SRC		0	// source register, $Sx
+#define OPND_DST		1	// destination register, $Dx
+#define OPND_LABEL		2	// label, resolved once parsing is done
+#define OPND_CONST		3	// previously defined constant
+#define OPND_LIT		4	// explicit literal, !x
+#define OPND_TERM		5	// empty word filled in during translation
+#define OPND_CLASSES	6
+
+// Compiled Format Limits
+#define MAX_OPERANDS	4
+#define MAX_ALTS		3
+
+// Indices into the opcode table
+enum opcode_idx{
+	OP_NOT, OP_SHL, OP_SHR, OP_OR, OP_AND, OP_ADD, OP_SW, OP_SI, OP_LW,
+	OP_LI, OP_BEZ, OP_ROT, OP_ROT1, OP_LROT, OP_JMP, OP_HALT, OP_NOP,
+	OP_LFSJ, OP_STJ,
+	OPCODE_CNT
+};
+
+/**
+ * opcode
+ * const char *name		The mnemonic as written in Hartz assembly
+ * unsigned char code	The opcode, left aligned in a word (see translator.h)
+ * short len			How many bits of the word the opcode takes up
+ * const char *fmt		The operand format string (see compile_format())
+ * short words			How many text ring words the instruction occupies
+ */
+struct opcode{
+	const char *name;
+	unsigned char code;
+	short len;
+	const char *fmt;
+	short words;
+};
+
+/**
+ * operand
+ * short alts[]			The operand classes to try, in order
+ * short alt_count		How many entries of alts are used, more than one
+ * 						means the operand came from an 'or' expression
+ */
+struct operand{
+	short alts[MAX_ALTS];
+	short alt_count;
+};
+
+/**
+ * operand_fmt
+ * struct operand ops[]	The operands of an instruction, in order
+ * short count			How many entries of ops are used
+ */
+struct operand_fmt{
+	struct operand ops[MAX_OPERANDS];
+	short count;
+};
+
+extern const struct opcode opcodes[OPCODE_CNT];
+extern const char word_strs[128][8];
+
+// Opcode Lookup
+const struct opcode *find_opcode(const char *tok);
+
+// Operand Formats
+int compile_format(const char *fmt, struct operand_fmt *out);
+int compile_formats();
+const struct operand_fmt *opcode_format(const struct opcode *op);
+
+#endif
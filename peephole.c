@@ -0,0 +1,331 @@
+/**
+ * File:		peephole.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	An optional pass over the parsed terms that rewrites short
+ * 				instruction sequences into cheaper ones before any symbol is
+ * 				resolved. The text ring only holds MAX_MEMORY words, so every
+ * 				word saved leaves room for more program. Nothing is moved
+ * 				across a label, since a jump may land there; labels are
+ * 				renumbered and the term table closed up once the rewritten
+ * 				terms are gone. Only distances to labels can be renumbered,
+ * 				so a program that jumps any other way is left as it is.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "symbols.h"
+#include "generrors.h"
+#include "terms.h"
+#include "arena.h"
+#include "opcodes.h"
+#include "peephole.h"
+#include "trace.h"
+
+static int fixed_jumps(struct program *prog);
+static int rewrite_terms(struct program *prog, const unsigned char *labels,
+		unsigned char *dead);
+static int thread_jump(struct program *prog, int o);
+static int jump_target(struct program *prog, int o);
+static int fold_rot_run(struct term_table *tt, int t,
+		const unsigned char *labels, unsigned char *dead, int *next);
+static void drop_dead_terms(struct program *prog, unsigned char *dead,
+		int *new_pos);
+static void index_labels(struct program *prog, unsigned char *labels);
+static int next_insn(const struct term_table *tt, int t);
+static int insn_reg(const struct term_table *tt, int t);
+
+/**
+ * Rewrites the terms of a parsed program until none of the following apply
+ * any more:
+ *
+ * 	NOP					-> (nothing)
+ * 	ROT1 (n times)		-> LROT !n, or fewer ROT1s, n taken modulo MAX_CACHE
+ * 	JMP L / L:			-> L:
+ * 	JMP L ... L: HALT	-> HALT
+ * 	JMP L ... L: JMP M	-> JMP M, the same for BEZ
+ * 	SW $sX / LW $dX		-> SW $sX
+ * 	LW $dX / SW $sX		-> LW $dX
+ *
+ * Dropping a NOP changes how many cycles a program takes, but nothing else.
+ * Nothing is rewritten in a program with a JMP or BEZ whose distance is a
+ * literal or a constant, since the words it jumps over may be the ones that
+ * go. Calls and returns are worked out from the positions of functions once
+ * the pass is done, so they need no such care.
+ *
+ * @param	prog	The program, parsed but not yet translated.
+ * @return			The number of words saved.
+ */
+int optimize_terms(struct program *prog){
+	int count = prog->terms.count;
+	if(fixed_jumps(prog)){
+		TRACE(prog, TRACE_PARSE, TRACE_PHASE, "peephole pass skipped, a jump "
+				"isn't to a label");
+		return 0;
+	}
+	unsigned char *labels = (unsigned char *) arena_alloc(prog->mem,
+			2 * (count + 1));
+	int *new_pos = (int *) arena_alloc(prog->mem, (count + 1) * sizeof(int));
+	if(!labels || !new_pos){
+		print_memory_error(prog);
+		return 0;
+	}
+	unsigned char *dead = labels + count + 1;
+	memset(dead, 0, count + 1);
+
+	// a rewrite can line up another, e.g. ROT1s either side of a NOP, or a
+	// threaded jump that now lands right after itself
+	index_labels(prog, labels);
+	while(rewrite_terms(prog, labels, dead)){
+		drop_dead_terms(prog, dead, new_pos);
+		index_labels(prog, labels);
+	}
+	return count - prog->terms.count;
+}
+
+/**
+ * Looks for a JMP or BEZ whose operand isn't a label, i.e. a distance that
+ * would no longer be right once words are dropped.
+ *
+ * @return			1 if there is one, otherwise 0.
+ */
+static int fixed_jumps(struct program *prog){
+	struct term_table *tt = &prog->terms;
+	int t = tt->count ? 1 : 0, o;
+	while(t){
+		if(tt->ops[t] == OP_JMP || tt->ops[t] == OP_BEZ){
+			o = t + opcodes[tt->ops[t]].words - 1;
+			if(tt->kinds[o] == TERM_DONE || 
+					!find_symbol(tt->refs[o], prog->tbl))
+				return 1;
+		}
+		t = next_insn(tt, t);
+	}
+	return 0;
+}
+
+/**
+ * Makes one pass over the instructions, marking the terms to drop.
+ *
+ * @param	prog	The program.
+ * @param	labels	Set for every position a label is defined at.
+ * @param	dead	Set for every term to drop, by position.
+ * @return			The number of rewrites made.
+ */
+static int rewrite_terms(struct program *prog, const unsigned char *labels,
+		unsigned char *dead){
+	const struct opcode *halt = &opcodes[OP_HALT];
+	struct term_table *tt = &prog->terms;
+	struct symbol *s;
+	int t = tt->count ? 1 : 0, n, o, to;
+	int changed = 0;
+	while(t){
+		n = next_insn(tt, t);
+		switch(tt->ops[t]){
+			case OP_NOP:
+				dead[t] = 1;
+				changed++;
+				break;
+			case OP_ROT1:
+				changed += fold_rot_run(tt, t, labels, dead, &n);
+				break;
+			case OP_JMP:
+
+				// a jump of no distance to a label that follows anyway
+				o = t + 1;
+				if(tt->kinds[o] != TERM_DONE &&
+						(s = find_symbol(tt->refs[o], prog->tbl)) &&
+						s->pos == o){
+					s->used = 1;
+					dead[t] = dead[o] = 1;
+					changed++;
+				}
+
+				// stopping is one word, jumping to a stop is two
+				else if((to = jump_target(prog, o)) &&
+						tt->ops[to] == OP_HALT){
+					if( (s = find_symbol(tt->refs[o], prog->tbl)) )
+						s->used = 1;
+					tt->ops[t] = OP_HALT;
+					tt->words[t] = halt->code;
+					dead[o] = 1;
+					changed++;
+				}
+				else
+					changed += thread_jump(prog, o);
+				break;
+			case OP_BEZ:
+				changed += thread_jump(prog, t + 1);
+				break;
+			case OP_SW:
+			case OP_LW:
+
+				// the second half of a round trip moves the same value back
+				if(n && !labels[n - 1] &&
+						tt->ops[n] == (tt->ops[t] == OP_SW ? OP_LW : OP_SW) &&
+						insn_reg(tt, n) == insn_reg(tt, t)){
+					dead[n] = 1;
+					n = next_insn(tt, n);
+					changed++;
+				}
+				break;
+		}
+		t = n;
+	}
+	return changed;
+}
+
+/**
+ * Points a jump that lands on an unconditional JMP straight at where that
+ * JMP goes, following any chain of them. The text ring only turns one way,
+ * so the direct distance is never longer than going through the chain, and
+ * the chained JMPs aren't read. The chain ends at a JMP whose distance isn't
+ * a label, which is kept as the target rather than followed.
+ *
+ * @param	prog	The program.
+ * @param	o		The position of the label operand of a JMP or BEZ.
+ * @return			1 if the jump was retargeted, otherwise 0.
+ */
+static int thread_jump(struct program *prog, int o){
+	struct term_table *tt = &prog->terms;
+	struct symbol *s;
+	int to = jump_target(prog, o), last = 0;
+	int hops = 0;
+	while(to && tt->ops[to] == OP_JMP && jump_target(prog, to + 1)){
+		last = to + 1;
+		to = jump_target(prog, last);
+
+		// a chain longer than the program goes round in circles
+		if(++hops > tt->count)
+			return 0;
+	}
+	if(!last || !strcmp(tt->refs[last], tt->refs[o]))
+		return 0;
+	if( (s = find_symbol(tt->refs[o], prog->tbl)) )
+		s->used = 1;
+	tt->refs[o] = tt->refs[last];
+	return 1;
+}
+
+/**
+ * Finds the instruction a jump operand lands on.
+ *
+ * @param	prog	The program.
+ * @param	o		The position of the operand of a JMP or BEZ.
+ * @return			The position of the instruction, or 0 if the operand
+ * 					isn't a label or the label is at the very end.
+ */
+static int jump_target(struct program *prog, int o){
+	struct symbol *s;
+	if(prog->terms.kinds[o] == TERM_DONE ||
+			!(s = find_symbol(prog->terms.refs[o], prog->tbl)) ||
+			s->pos < 0 || s->pos >= prog->terms.count)
+		return 0;
+	return s->pos + 1;
+}
+
+/**
+ * Folds a run of ROT1s that no label splits into the fewest words that
+ * rotate the data ring as far.
+ *
+ * @param	tt		The terms of the program.
+ * @param	t		The position of the first ROT1 of the run.
+ * @param	labels	Set for every position a label is defined at.
+ * @param	dead	Set for every term to drop, by position.
+ * @param	next	Set to the instruction after the run, 0 at the end.
+ * @return			1 if the run was rewritten, otherwise 0.
+ */
+static int fold_rot_run(struct term_table *tt, int t,
+		const unsigned char *labels, unsigned char *dead, int *next){
+	int n = t + 1;
+	int run = 1, keep, i;
+	while(n <= tt->count && tt->ops[n] == OP_ROT1 && !labels[n - 1]){
+		run++;
+		n++;
+	}
+	*next = n <= tt->count ? n : 0;
+
+	// a full turn of the data ring ends where it started
+	keep = run % MAX_CACHE;
+	if(keep >= MIN_ROT_RUN){
+		tt->ops[t] = OP_LROT;
+		tt->words[t] = opcodes[OP_LROT].code;
+
+		// the second ROT1 becomes the rotation
+		tt->ops[t + 1] = -1;
+		tt->words[t + 1] = run % MAX_CACHE;
+		tt->kinds[t + 1] = TERM_DONE;
+		keep = 2;
+	}
+	if(keep >= run)
+		return 0;
+	for(i = keep; i < run; i++)
+		dead[t + i] = 1;
+	return 1;
+}
+
+/**
+ * Drops the terms marked dead and moves every later term and label down to
+ * close the gap.
+ *
+ * @param	prog	The program.
+ * @param	dead	Set for every term to drop, by position; cleared again.
+ * @param	new_pos	Scratch space, one entry per position.
+ */
+static void drop_dead_terms(struct program *prog, unsigned char *dead,
+		int *new_pos){
+	struct term_table *tt = &prog->terms;
+	struct symbol *s;
+	int i;
+
+	// the position a term or label at each old position ends up at
+	new_pos[0] = 0;
+	for(i = 1; i <= tt->count; i++)
+		new_pos[i] = new_pos[i - 1] + !dead[i];
+	for(s = prog->tbl->r; s; s = s->next){
+		if(s->pos >= 0)
+			s->pos = new_pos[s->pos];
+	}
+
+	for(i = 1; i <= tt->count; i++){
+		if(dead[i])
+			dead[i] = 0;
+		else if(new_pos[i] != i)
+			move_term(tt, new_pos[i], i);
+	}
+	tt->count = new_pos[tt->count];
+}
+
+/**
+ * Marks every position a label or function is defined at; a label at
+ * position p sits directly before the term at p + 1.
+ */
+static void index_labels(struct program *prog, unsigned char *labels){
+	struct symbol *s;
+	memset(labels, 0, prog->terms.count + 1);
+	for(s = prog->tbl->r; s; s = s->next){
+		if(s->pos >= 0)
+			labels[s->pos] = 1;
+	}
+}
+
+/**
+ * Skips the operand words of an instruction.
+ *
+ * @return			The position of the next instruction, or 0 at the end of
+ * 					the program.
+ */
+static int next_insn(const struct term_table *tt, int t){
+	t += opcodes[tt->ops[t]].words;
+	return t <= tt->count ? t : 0;
+}
+
+/**
+ * The register an SW or LW names, which directly follows the opcode.
+ */
+static int insn_reg(const struct term_table *tt, int t){
+	return (tt->words[t] >> (WORD_SIZE - opcodes[tt->ops[t]].len - REG_BITS)) &
+			((1 << REG_BITS) - 1);
+}
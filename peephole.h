@@ -0,0 +1,14 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+// Rewrites
+// A run of ROT1s is only worth folding into an LROT (two words) once it is
+// at least this long; shorter runs cost the same either way
+#define MIN_ROT_RUN		3
+
+struct program;
+
+// Peephole Optimization
+int optimize_terms(struct program *prog);
+
+#endif
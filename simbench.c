@@ -0,0 +1,235 @@
+/**
+* File: simbench.c
+* Author: Grant Kurtz
+*
+* Description: Measures how fast the simulator runs. Every test program is
+* translated in memory, then run over and over, both one step at a time
+* (run_machine()) and predecoded (run_decoded()), and the simulated cycles per
+* second of each are reported. Each program is then run once for every pair
+* of starting registers, one machine at a time and in lockstep batches
+* (run_many()). The engines must also agree on the outcome.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "libhartz.h"
+#include "machine.h"
+#include "dispatch.h"
+#include "batch.h"
+#include "source.h"
+#include "test.h"
+
+// Benchmark Sizing
+#define BENCH_CYCLES	10000	// cycle limit of a single run, for loops
+#define BENCH_TIME		0.2		// seconds to spend on each engine
+
+static int bench_program(const char *name, struct machine *start);
+static double run_engine(const struct machine *start, struct decoded_ring *d,
+		unsigned long *cycles, struct machine *end);
+static int bench_all_inputs(const char *name, const struct machine *start);
+static double now();
+static int name_order(const void *a, const void *b);
+
+int main(int argc, char **argv){
+	const char *dir_name = argc > 1 ? argv[1] : TEST_IN;
+	DIR *dir = opendir(dir_name);
+	if(!dir){
+		fprintf(stderr, "Unable to open '%s'!\n", dir_name);
+		return 1;
+	}
+
+	// collect the programs first, so they're reported in order
+	char **names = 0;
+	int count = 0, size = 0, i, failed = 0;
+	struct dirent *ent;
+	while((ent = readdir(dir))){
+		if(ent->d_name[0] == '.')
+			continue;
+		if(count == size){
+			size = size ? size * 2 : 16;
+			names = (char **) realloc(names, size * sizeof(char *));
+		}
+		names[count] = (char *) malloc(strlen(ent->d_name) + 1);
+		strcpy(names[count++], ent->d_name);
+	}
+	closedir(dir);
+	qsort(names, count, sizeof(char *), name_order);
+
+	printf("%-16s %6s %10s %14s %14s %8s\n", "program", "words",
+			"cycles/run", "step cyc/s", "decoded cyc/s", "speedup");
+	char path[PATH_MAX + NAME_MAX];
+	struct machine *starts = (struct machine *) calloc(count,
+			sizeof(struct machine));
+	short *loaded = (short *) calloc(count, sizeof(short));
+	for(i = 0; i < count; i++){
+		snprintf(path, sizeof(path), "%s%s%s", dir_name,
+				dir_name[strlen(dir_name)-1] == '/' ? "" : "/", names[i]);
+		loaded[i] = !bench_program(path, &starts[i]);
+		failed |= !loaded[i];
+	}
+
+	printf("\n%-16s %6s %14s %14s %8s\n", "program", "inputs",
+			"decoded ms", "batch ms", "speedup");
+	for(i = 0; i < count; i++){
+		if(loaded[i])
+			failed |= bench_all_inputs(names[i], &starts[i]);
+		free(names[i]);
+	}
+	free(names);
+	free(starts);
+	free(loaded);
+	return failed;
+}
+
+/**
+* Translates one program and times both engines on it.
+*
+* @param name 		The path of the program.
+* @param start 		Set to the machine loaded with the program.
+* @return 			0 on success, 1 if the program couldn't be run or the
+* 					engines disagreed.
+*/
+static int bench_program(const char *name, struct machine *start){
+	FILE *in = fopen(name, "r");
+	struct source src;
+	if(!in || open_source(&src, in)){
+		if(in)
+			fclose(in);
+		fprintf(stderr, "%s: unable to read\n", name);
+		return 1;
+	}
+	fclose(in);
+	struct hartz_result res;
+	hartz_translate(src.data, src.size, 0, &res);
+	close_source(&src);
+	if(res.error_code || res.word_count > MAX_MEMORY){
+		fprintf(stderr, "%s: does not translate to a program\n", name);
+		hartz_free_result(&res);
+		return 1;
+	}
+
+	struct machine step_end, fast_end;
+	struct decoded_ring d;
+	unsigned long step_cycles, fast_cycles;
+	reset_machine(start);
+	load_words(start, res.words, res.word_count);
+	predecode(start, &d);
+	double step_rate = run_engine(start, 0, &step_cycles, &step_end);
+	double fast_rate = run_engine(start, &d, &fast_cycles, &fast_end);
+
+	const char *base = strrchr(name, '/');
+	printf("%-16s %6zu %10lu %14.0f %14.0f %7.1fx\n", base ? base + 1 : name,
+			res.word_count, step_end.cycles, step_rate, fast_rate,
+			fast_rate / step_rate);
+	hartz_free_result(&res);
+
+	if(memcmp(&step_end, &fast_end, sizeof(struct machine))){
+		fprintf(stderr, "%s: the engines disagree!\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+* Runs a program once for every pair of starting registers, first predecoded
+* one machine at a time, then in lockstep batches, and times both.
+*
+* @param name 		The program's name, for the report.
+* @param start 		The loaded machine to start from.
+* @return 			0 on success, 1 if the engines disagreed.
+*/
+static int bench_all_inputs(const char *name, const struct machine *start){
+	size_t count = (size_t) (MAX_INT + 1) * (MAX_INT + 1), i;
+	struct machine *single = (struct machine *) malloc(count *
+			sizeof(struct machine));
+	struct machine *many = (struct machine *) malloc(count *
+			sizeof(struct machine));
+	struct decoded_ring d;
+	int failed = 0;
+	for(i = 0; i < count; i++){
+		single[i] = *start;
+		single[i].regs[0] = i / (MAX_INT + 1);
+		single[i].regs[1] = i % (MAX_INT + 1);
+		many[i] = single[i];
+	}
+
+	double begin = now();
+	predecode(start, &d);
+	for(i = 0; i < count; i++)
+		run_decoded(&single[i], &d, BENCH_CYCLES);
+	double single_time = now() - begin;
+	begin = now();
+	run_many(many, count, BENCH_CYCLES);
+	double many_time = now() - begin;
+
+	printf("%-16s %6zu %14.2f %14.2f %7.1fx\n", name, count,
+			single_time * 1000, many_time * 1000, single_time / many_time);
+	for(i = 0; i < count && !failed; i++){
+		if(memcmp(&single[i], &many[i], sizeof(struct machine))){
+			fprintf(stderr, "%s: the batch disagrees on $1=%zu $2=%zu!\n",
+					name, i / (MAX_INT + 1), i % (MAX_INT + 1));
+			failed = 1;
+		}
+	}
+	free(single);
+	free(many);
+	return failed;
+}
+
+/**
+* Runs a program from the same starting state until BENCH_TIME has passed.
+*
+* @param start 		The loaded machine to start every run from.
+* @param d 			The decoded program, or 0 to step with run_machine().
+* @param cycles 	Set to the total cycles simulated.
+* @param end 		Set to the state the last run ended in.
+* @return 			Simulated cycles per second.
+*/
+static double run_engine(const struct machine *start, struct decoded_ring *d,
+		unsigned long *cycles, struct machine *end){
+	unsigned long runs = 0, batch = 1, i;
+	double begin = now(), elapsed;
+	*cycles = 0;
+	do{
+		for(i = 0; i < batch; i++){
+			*end = *start;
+			if(d)
+				run_decoded(end, d, BENCH_CYCLES);
+			else
+				run_machine(end, BENCH_CYCLES);
+			*cycles += end->cycles;
+		}
+		runs += batch;
+		batch *= 2;
+		elapsed = now() - begin;
+	}while(elapsed < BENCH_TIME);
+	return *cycles / elapsed;
+}
+
+/**
+* Orders names by length first, so "test.10" comes after "test.9".
+*/
+static int name_order(const void *a, const void *b){
+	const char *na = *(const char *const *) a, *nb = *(const char *const *) b;
+	size_t la = strlen(na), lb = strlen(nb);
+	if(la != lb)
+		return la < lb ? -1 : 1;
+	return strcmp(na, nb);
+}
+
+/**
+* @return 			A monotonic time in seconds.
+*/
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
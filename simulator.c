@@ -0,0 +1,223 @@
+/**
+* File: simulator.c
+* Author: Grant Kurtz
+*
+* Description: Runs a program produced by the translator on a simulated Hartz
+* machine and reports how many cycles it took, how often each instruction
+* ran and the state the machine was left in.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "dispatch.h"
+#include "batch.h"
+#include "states.h"
+#include "source.h"
+#include "idents.h"
+#include "strlib.h"
+#include "generrors.h"
+
+// Flags
+#define CYCLE_FLAG	"-c"	// followed by the cycle limit, 0 for none
+#define REGS_FLAG	"-r"	// followed by the starting registers, "$1,$2"
+#define DATA_FLAG	"-d"	// followed by the starting data ring, "d0,d1,..."
+#define ALL_FLAG	"-a"	// run every pair of starting registers
+
+// The cycle limit unless one is given
+#define DEF_CYCLES	1000000
+
+static int run_all_inputs(const struct machine *start, unsigned long max_cycles);
+static void print_report(const struct machine *m, int ret,
+		unsigned long loop_start);
+static void print_usage(const char *prog_name);
+
+int main(int argc, char **argv){
+	if(argc < 2){
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	struct machine m;
+	unsigned long max_cycles = DEF_CYCLES;
+	short all = 0;
+	reset_machine(&m);
+	int c;
+	for(c = 2; c < argc; c += 2){
+		if(strcmp(argv[c], ALL_FLAG) == 0)
+			all = 1, c--;
+		else if(c + 1 == argc)
+			c = 0;
+		else if(strcmp(argv[c], CYCLE_FLAG) == 0)
+			max_cycles = strtoul(argv[c+1], 0, 10);
+		else if(strcmp(argv[c], REGS_FLAG) == 0 &&
+				read_values(argv[c+1], m.regs, MAX_REGS, MAX_INT) > 0)
+			;
+		else if(strcmp(argv[c], DATA_FLAG) == 0 &&
+				read_values(argv[c+1], m.data, MAX_CACHE, MAX_INT) > 0)
+			;
+		else
+			c = 0;
+		if(!c){
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// read the whole program, text or image, and put it on the text ring
+	FILE *in = fopen(argv[1], "r");
+	struct source src;
+	if(!in || open_source(&src, in)){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Unable to read '%s'.\n", argv[1]);
+		if(in)
+			fclose(in);
+		return 2;
+	}
+	fclose(in);
+	int words = load_program(&m, src.data, src.size);
+	close_source(&src);
+	if(words < 0){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: '%s' is not a program for this machine (%s).\n",
+				argv[1], words == LOAD_TOO_BIG ? "too large" : 
+				words == LOAD_BAD_WORD ? "bad word" : "bad image");
+		return 2;
+	}
+
+	if(all)
+		return run_all_inputs(&m, max_cycles);
+	unsigned long loop_start = 0;
+	int ret = run_watched(&m, max_cycles, &loop_start);
+	if(ret == RUN_NO_MEMORY){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Not enough memory available to watch for "
+				"loops!\n");
+		return ALLOC_ERR;
+	}
+	print_report(&m, ret, loop_start);
+	return ret == RUN_HALTED ? 0 : 1;
+}
+
+/**
+* Runs the program once for every pair of starting registers, all at once (see
+* batch.c), and prints one line per pair: the starting registers, how the run
+* ended, the cycles it took, the final registers and the final data ring.
+*
+* @param start 		The loaded machine, with the starting data ring.
+* @param max_cycles The cycle limit of each run.
+* @return 			0 if every run halted, ALLOC_ERR if there isn't memory
+* 					for all of them, otherwise 1.
+*/
+static int run_all_inputs(const struct machine *start,
+		unsigned long max_cycles){
+	size_t count = (size_t) (MAX_INT + 1) * (MAX_INT + 1), halted, i;
+	unsigned long most = 0;
+	struct machine *ms = (struct machine *) malloc(count *
+			sizeof(struct machine));
+	int j;
+	if(!ms){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Not enough memory available to run every "
+				"input!\n");
+		return ALLOC_ERR;
+	}
+	for(i = 0; i < count; i++){
+		ms[i] = *start;
+		ms[i].regs[0] = i / (MAX_INT + 1);
+		ms[i].regs[1] = i % (MAX_INT + 1);
+	}
+	halted = run_many(ms, count, max_cycles);
+
+	for(i = 0; i < count; i++){
+		const struct machine *m = &ms[i];
+		printf("%3zu %3zu %c %8lu %3d %3d ", i / (MAX_INT + 1),
+				i % (MAX_INT + 1), m->halted ? 'H' :
+				m->fault_pos >= 0 ? 'I' : 'L', m->cycles, m->regs[0],
+				m->regs[1]);
+		for(j = 0; j < MAX_CACHE; j++)
+			printf("%s%d", j ? "," : "", m->data[j]);
+		printf("\n");
+		if(m->cycles > most)
+			most = m->cycles;
+	}
+	printf("Halted %zu of %zu runs, taking at most %lu cycles.\n", halted,
+			count, most);
+	free(ms);
+	return halted != count;
+}
+
+/**
+* Prints how the run ended, the cycle and instruction counts, and the final
+* state of the machine.
+*
+* @param m 			The machine after the run.
+* @param ret 		How the run ended, one of the RUN_* results.
+* @param loop_start For RUN_LOOP, the cycle the repeated state was first
+* 					reached at.
+*/
+static void print_report(const struct machine *m, int ret,
+		unsigned long loop_start){
+	int i;
+	printf("\t\t=== Hartz Simulator ===\n");
+	if(ret == RUN_HALTED)
+		print_asterisk(GRN_C, stdout), printf("Halted.\n");
+	else if(ret == RUN_LIMIT)
+		print_asterisk(YLW_C, stdout), printf("Cycle limit reached.\n");
+	else if(ret == RUN_LOOP){
+		print_asterisk(RED_C, stdout);
+		printf("Loop detected at cycle %lu: the state from cycle %lu "
+				"repeated, every %lu cycles.\n", m->cycles, loop_start,
+				m->cycles - loop_start);
+	}
+	else{
+		print_asterisk(RED_C, stdout);
+		printf("Illegal instruction %s at text position %d.\n",
+				word_strs[m->text[m->fault_pos]], m->fault_pos);
+	}
+	printf("Cycles:\t\t%lu\n", m->cycles);
+	printf("Instructions:\t%lu\n", m->executed);
+
+	printf("\nInstruction Counts\n");
+	for(i = 0; i < SIM_OPS; i++){
+		if(m->counts[i])
+			printf("\t%-5s\t%lu\n", op_name(i), m->counts[i]);
+	}
+
+	printf("\nRegisters\n");
+	for(i = 0; i < MAX_REGS; i++)
+		printf("\t$%d\t%s (%d)\n", i + 1, word_strs[m->regs[i]], m->regs[i]);
+	printf("\tjump\t%s (%d)\n", word_strs[m->jump], m->jump);
+
+	printf("\nData Ring (head at %d)\n", m->dp);
+	for(i = 0; i < MAX_CACHE; i++)
+		printf("\t%c%d\t%s (%d)\n", i == m->dp ? '>' : ' ', i, 
+				word_strs[m->data[i]], m->data[i]);
+
+	printf("\nText Ring (head at %d)\n", m->tp);
+	for(i = 0; i < MAX_MEMORY; i++){
+		int op = decode_word(m->text[i]);
+		printf("\t%c%d\t%s %s\n", i == m->tp ? '>' : ' ', i,
+				word_strs[m->text[i]], op_name(op));
+	}
+}
+
+/**
+* Prints how to call the simulator.
+*/
+static void print_usage(const char *prog_name){
+	printf("usage: %s <program> [flags]\n"
+			"Runs a program written by the translator (text or image).\n"
+			"Options (make separate):\n"
+			" -a\t\tRun with every pair of starting registers, one line "
+			"each:\n"
+			"\t\t$1 $2 (H)alted/(I)llegal/(L)imit cycles $1 $2 d0,...\n"
+			" -c <cycles>\tStop after this many cycles, 0 for no limit "
+			"(default %d)\n"
+			" -d <d0,...>\tStart with these values on the data ring\n"
+			" -r <$1,$2>\tStart with these values in the registers\n",
+			prog_name, DEF_CYCLES);
+}
@@ -0,0 +1,182 @@
+/**
+ * File:		source.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Gives line-at-a-time access to an input program.  The file is
+ * 				memory mapped where possible (falling back to a single read
+ * 				into the heap otherwise), and lines are handed out as slices
+ * 				of that buffer, so there is no limit on line length and no
+ * 				need to seek back into the file when reporting errors.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+#include "strlib.h"
+
+static int read_source(struct source *src, FILE *in);
+
+/**
+ * Makes the contents of an already opened file available to next_line().
+ *
+ * @param	src		The source to set up.
+ * @param	in		The opened input file.
+ * @return			0 on success, otherwise -1 if the input couldn't be read
+ * 					or memory ran out.
+ */
+int open_source(struct source *src, FILE *in){
+	memset(src, 0, sizeof(struct source));
+	struct stat st;
+	if(!fstat(fileno(in), &st) && S_ISREG(st.st_mode) && st.st_size > 0){
+		void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 
+				0);
+		if(map != MAP_FAILED){
+			src->data = (char *) map;
+			src->size = st.st_size;
+			src->mapped = 1;
+			return 0;
+		}
+	}
+
+	// pipes, empty files and the like
+	return read_source(src, in);
+}
+
+/**
+ * Reads input straight out of a buffer the caller already has in memory. The
+ * buffer is only ever read, and must outlive the source.
+ *
+ * @param	src		The source to set up.
+ * @param	data	The input program.
+ * @param	size	The number of bytes in data.
+ */
+void open_source_buffer(struct source *src, const char *data, size_t size){
+	memset(src, 0, sizeof(struct source));
+	src->data = (char *) data;
+	src->size = size;
+	src->borrowed = 1;
+}
+
+/**
+ * Unmaps (or frees) the input and the token scratch buffer.
+ */
+void close_source(struct source *src){
+	if(src->borrowed)
+		;
+	else if(src->mapped)
+		munmap(src->data, src->size);
+	else
+		free(src->data);
+	free(src->buf);
+	memset(src, 0, sizeof(struct source));
+}
+
+/**
+ * Advances to the next line of input.
+ *
+ * @param	src		The source to read from.
+ * @return			1 if there was another line, otherwise 0.
+ */
+int next_line(struct source *src){
+	if(src->off >= src->size)
+		return 0;
+	const char *start = src->data + src->off;
+	const char *end = memchr(start, '\n', src->size - src->off);
+	if(end){
+		src->line_len = end - start;
+		src->off += src->line_len + 1;
+	}
+	else{
+		src->line_len = src->size - src->off;
+		src->off = src->size;
+	}
+	src->line = start;
+	return 1;
+}
+
+/**
+ * Finds the current line without leading and trailing whitespace.
+ *
+ * @param	src		The source holding the current line.
+ * @param	start	Set to the first non-whitespace character.
+ * @return			The number of characters left after trimming.
+ */
+size_t trimmed_line(const struct source *src, const char **start){
+	const char *s = src->line;
+	size_t len = src->line_len;
+	while(len && isspace((unsigned char) s[len-1]))
+		len--;
+	while(len && isspace((unsigned char) *s))
+		s++, len--;
+	*start = s;
+	return len;
+}
+
+/**
+ * Copies the current line (trimmed, in uppercase) into the scratch buffer and
+ * returns its first token. Further tokens are read with next_token().
+ *
+ * @param	src		The source holding the current line.
+ * @return			The first token, or 0 if the line is only whitespace or
+ * 					memory ran out.
+ */
+char *first_token(struct source *src){
+	const char *s;
+	size_t len = trimmed_line(src, &s);
+	if(len + 1 > src->buf_size){
+		size_t size = src->buf_size ? src->buf_size : SRC_LINE_INIT;
+		while(size < len + 1)
+			size *= 2;
+		char *buf = (char *) realloc(src->buf, size);
+		if(!buf)
+			return 0;
+		src->buf = buf;
+		src->buf_size = size;
+	}
+	memcpy(src->buf, s, len);
+	src->buf[len] = '\0';
+	strtoupper(src->buf, len);
+	return strtok_r(src->buf, STR_TOK_SEP, &src->tok_save);
+}
+
+/**
+ * Returns the next token of the current line. The tokenizer state is kept in
+ * the source rather than inside strtok(), so several sources can be read at
+ * once (from different threads).
+ *
+ * @param	src		The source holding the current line.
+ * @param	sep		The characters separating tokens.
+ * @return			The next token, or 0 at the end of the line.
+ */
+char *next_token(struct source *src, const char *sep){
+	if(!src->buf)
+		return 0;
+	return strtok_r(0, sep, &src->tok_save);
+}
+
+/**
+ * Reads the whole input into the heap for inputs that can't be mapped.
+ */
+static int read_source(struct source *src, FILE *in){
+	size_t cap = 0;
+	size_t got;
+	do{
+		if(src->size == cap){
+			size_t size = cap ? cap * 2 : SRC_READ_CHUNK;
+			char *data = (char *) realloc(src->data, size);
+			if(!data)
+				return -1;
+			src->data = data;
+			cap = size;
+		}
+		got = fread(src->data + src->size, 1, cap - src->size, in);
+		src->size += got;
+	}while(got);
+	return ferror(in) ? -1 : 0;
+}
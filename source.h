@@ -0,0 +1,48 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Source Buffer Sizing
+#define SRC_READ_CHUNK	4096	// growth step when the input can't be mapped
+#define SRC_LINE_INIT	64		// initial size of the token scratch buffer
+
+/**
+ * source
+ * char *data			The whole input, either mapped or read into the heap
+ * size_t size			The number of bytes in data
+ * size_t off			Offset of the next unread line in data
+ * short mapped			1 if data is a memory mapping, 0 if it was malloc'd
+ * short borrowed		1 if data belongs to the caller and is left alone
+ * const char *line		The current line, a slice of data (not nul-terminated)
+ * size_t line_len		The length of line, without the newline
+ * char *buf			Scratch copy of the current line used for tokenizing
+ * size_t buf_size		The allocated size of buf
+ * char *tok_save		Tokenizer position within buf (see next_token())
+ */
+struct source{
+	char *data;
+	size_t size;
+	size_t off;
+	short mapped;
+	short borrowed;
+	const char *line;
+	size_t line_len;
+	char *buf;
+	size_t buf_size;
+	char *tok_save;
+};
+
+// Source Lifetime
+int open_source(struct source *src, FILE *in);
+void open_source_buffer(struct source *src, const char *data, size_t size);
+void close_source(struct source *src);
+
+// Line Processing
+int next_line(struct source *src);
+char *first_token(struct source *src);
+char *next_token(struct source *src, const char *sep);
+size_t trimmed_line(const struct source *src, const char **start);
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * File:		states.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Notices when a simulated program will never halt. A Hartz
+ * 				machine has so little state that it fits in a few bytes, and
+ * 				the machine is deterministic, so a program that doesn't halt
+ * 				must eventually come back to a state it was already in, after
+ * 				which it repeats itself forever. Every state reached is kept
+ * 				in a hash set, and the run stops at the first one seen twice.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "translator.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "states.h"
+
+static unsigned int hash_state(const unsigned char *key);
+static int grow_states(struct state_set *set);
+
+/**
+ * Starts an empty set.
+ */
+void init_state_set(struct state_set *set){
+	set->slots = 0;
+	set->slot_count = 0;
+	set->used = 0;
+}
+
+/**
+ * Frees the states held, leaving the set empty.
+ */
+void free_state_set(struct state_set *set){
+	free(set->slots);
+	init_state_set(set);
+}
+
+/**
+ * Packs everything about a machine that decides what it does next.
+ *
+ * @param	m		The machine.
+ * @param	key		Filled with STATE_BYTES bytes.
+ */
+void pack_state(const struct machine *m, unsigned char *key){
+	key[0] = m->tp;
+	key[1] = m->dp;
+	key[2] = m->jump;
+	key[3] = m->mult;
+	memcpy(key + 4, m->regs, MAX_REGS);
+	memcpy(key + 4 + MAX_REGS, m->data, MAX_CACHE);
+}
+
+/**
+ * Finds a state in the set, adding it if it isn't there yet.
+ *
+ * @param	set		The set.
+ * @param	key		The packed state.
+ * @param	found	Set to 1 if the state was already there, otherwise 0.
+ * @return			The state's slot, which stays valid until the next state
+ * 					is added. A new slot's val is 0 and must be set. 0 if
+ * 					there wasn't enough memory to make room for it.
+ */
+struct state_slot *add_state(struct state_set *set, const unsigned char *key,
+		int *found){
+
+	// keep the table at most half full
+	if(2 * (set->used + 1) > set->slot_count && grow_states(set))
+		return 0;
+
+	size_t mask = set->slot_count - 1;
+	size_t i = hash_state(key) & mask;
+	struct state_slot *slot;
+	while((slot = &set->slots[i])->val){
+		if(!memcmp(slot->key, key, STATE_BYTES)){
+			*found = 1;
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+	memcpy(slot->key, key, STATE_BYTES);
+	set->used++;
+	*found = 0;
+	return slot;
+}
+
+/**
+ * Adds the machine's current state to the set, unless it's already there.
+ *
+ * @param	set			The states visited so far.
+ * @param	m			The machine.
+ * @param	first_seen	Set to the cycle count the state was first reached
+ * 						at, if it was.
+ * @return				1 if the state was visited before, 0 if not, or -1
+ * 						if there wasn't enough memory to add it.
+ */
+int visit_state(struct state_set *set, const struct machine *m,
+		unsigned long *first_seen){
+	unsigned char key[STATE_BYTES];
+	int found;
+	pack_state(m, key);
+	struct state_slot *slot = add_state(set, key, &found);
+	if(!slot)
+		return -1;
+	if(found)
+		*first_seen = slot->val - 1;
+	else
+		slot->val = m->cycles + 1;
+	return found;
+}
+
+/**
+ * Runs the machine like run_machine(), but also stops as soon as it comes
+ * back to a state it was in before.
+ *
+ * @param	m			The machine to run.
+ * @param	max_cycles	The most cycles to run for, 0 for no limit.
+ * @param	loop_start	Set to the cycle count the repeated state was first
+ * 						reached at, when RUN_LOOP is returned; the loop takes
+ * 						m->cycles less this many cycles to go around.
+ * @return				RUN_HALTED, RUN_ILLEGAL, RUN_LIMIT, RUN_LOOP, or
+ * 						RUN_NO_MEMORY if the states seen outgrew memory.
+ */
+int run_watched(struct machine *m, unsigned long max_cycles,
+		unsigned long *loop_start){
+	struct state_set set;
+	int ret = RUN_LIMIT, seen;
+	init_state_set(&set);
+	while(!max_cycles || m->cycles < max_cycles){
+		if(!m->halted && (seen = visit_state(&set, m, loop_start))){
+			ret = seen < 0 ? RUN_NO_MEMORY : RUN_LOOP;
+			break;
+		}
+		if((ret = step_machine(m)) >= 0)
+			break;
+		ret = RUN_LIMIT;
+	}
+	free_state_set(&set);
+	return ret;
+}
+
+/**
+ * FNV-1a over the packed state, as hash_iden() does for identifiers.
+ */
+static unsigned int hash_state(const unsigned char *key){
+	unsigned int h = 2166136261u;
+	int i;
+	for(i = 0; i < STATE_BYTES; i++){
+		h ^= key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Doubles the slot array (or creates it) and re-inserts every state.
+ *
+ * @return		0 on success, -1 if there wasn't enough memory, in which case
+ * 				the set is left as it was.
+ */
+static int grow_states(struct state_set *set){
+	size_t count = set->slot_count ? set->slot_count * 2 : STATE_SLOTS_INIT;
+	struct state_slot *old = set->slots;
+	size_t old_count = set->slot_count, i, j;
+	struct state_slot *slots = (struct state_slot *) calloc(count,
+			sizeof(struct state_slot));
+	if(!slots)
+		return -1;
+	set->slots = slots;
+	set->slot_count = count;
+	for(i = 0; i < old_count; i++){
+		if(!old[i].val)
+			continue;
+		j = hash_state(old[i].key) & (count - 1);
+		while(set->slots[j].val)
+			j = (j + 1) & (count - 1);
+		set->slots[j] = old[i];
+	}
+	free(old);
+	return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef STATES_H
+#define STATES_H
+
+#include <stddef.h>
+
+// Packed State Size
+// The text ring never changes, so a state is where its head is plus
+// everything that can be written: the data ring and its head, the registers,
+// the jump register and any pending LJMP multiplier.
+#define STATE_BYTES		(4 + MAX_REGS + MAX_CACHE)
+
+// Hash Table Sizing
+#define STATE_SLOTS_INIT	1024	// must be a power of two
+
+/**
+ * state_slot
+ * unsigned char key[]		The packed state, see pack_state()
+ * unsigned long val		Whatever the user of the set keeps for the state,
+ * 							never 0, which marks an empty slot
+ */
+struct state_slot{
+	unsigned char key[STATE_BYTES];
+	unsigned long val;
+};
+
+/**
+ * state_set
+ * A set of machine states, each with a value kept for it; for instance every
+ * state a machine has been in, to notice the first one it comes back to. A
+ * program that repeats a state runs the same instructions from it as it did
+ * the first time, forever.
+ *
+ * struct state_slot *slots	Open-addressed (linear probe) table of the states
+ * size_t slot_count		The size of slots, always a power of two
+ * size_t used				The number of states held
+ */
+struct state_set{
+	struct state_slot *slots;
+	size_t slot_count;
+	size_t used;
+};
+
+// State Set Lifetime
+void init_state_set(struct state_set *set);
+void free_state_set(struct state_set *set);
+
+// State Lookup
+void pack_state(const struct machine *m, unsigned char *key);
+struct state_slot *add_state(struct state_set *set, const unsigned char *key,
+		int *found);
+
+// Loop Detection
+int visit_state(struct state_set *set, const struct machine *m,
+		unsigned long *first_seen);
+int run_watched(struct machine *m, unsigned long max_cycles,
+		unsigned long *loop_start);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * File:		stats.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Times the phases of a translation and prints the report of
+ * 				the -t flag, which is meant to be read by other programs as
+ * 				much as by people (see stats.h for the format).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "translator.h"
+#include "symbols.h"
+#include "terms.h"
+#include "arena.h"
+#include "stats.h"
+
+// The key of each phase in the report, indexed by PHASE_*
+static const char *const phase_keys[PHASE_CNT] = {
+	[PHASE_READ]		= "time.read",
+	[PHASE_PARSE]		= "time.parse",
+	[PHASE_OPTIMIZE]	= "time.optimize",
+	[PHASE_RESOLVE]		= "time.resolve",
+	[PHASE_WRITE]		= "time.write",
+	[PHASE_WARN]		= "time.warnings",
+};
+
+static void add_table(struct trans_stats *st, const struct symbol_table *tbl);
+
+/**
+ * The current time of a clock that only ever goes forward, in seconds.
+ */
+double stats_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Adds the time since start to a phase.
+ *
+ * @param	prog	The program being translated.
+ * @param	phase	The phase that just ended (PHASE_*).
+ * @param	start	When it started, see stats_clock().
+ * @return			The current time, for the start of the next phase.
+ */
+double stats_lap(struct program *prog, int phase, double start){
+	double now = stats_clock();
+	prog->stats.phase[phase] += now - start;
+	return now;
+}
+
+/**
+ * Takes the counters out of the symbol tables, the term table and the arena
+ * of a program, before process_input_program() empties them again.
+ */
+void collect_stats(struct program *prog){
+	struct trans_stats *st = &prog->stats;
+	const struct term_table *tt = &prog->terms;
+	st->lines = prog->line_count;
+	st->symbols = prog->tbl->sym_count + prog->const_tbl->sym_count;
+	add_table(st, prog->tbl);
+	add_table(st, prog->const_tbl);
+	add_table(st, &prog->fix.pending);
+	if(prog->mem)
+		st->allocated += prog->mem->total;
+	st->allocated += tt->size * (sizeof(*tt->words) + sizeof(*tt->ops) +
+			sizeof(*tt->kinds) + sizeof(*tt->lines) + sizeof(*tt->refs) +
+			sizeof(*tt->fixups));
+}
+
+/**
+ * Prints the -t report of a finished translation. The stream is held while
+ * the report is written, so the reports of a batch don't run into each other.
+ */
+void print_stats(struct program *prog){
+	const struct trans_stats *st = &prog->stats;
+	FILE *out = prog->msg;
+	int i;
+	flockfile(out);
+	fprintf(out, "stats.version %d\n", STATS_VERSION);
+	fprintf(out, "stats.file %s\n", prog->input ? prog->input : "-");
+	fprintf(out, "stats.status %d\n", prog->error_code);
+	for(i = 0; i < PHASE_CNT; i++)
+		fprintf(out, "%s %.6f\n", phase_keys[i], st->phase[i]);
+	fprintf(out, "time.total %.6f\n", st->total);
+	fprintf(out, "count.lines %lu\n", st->lines);
+	fprintf(out, "count.terms %lu\n", st->terms);
+	fprintf(out, "count.words %lu\n", st->words);
+	fprintf(out, "count.symbols %lu\n", st->symbols);
+	fprintf(out, "count.lookups %lu\n", st->lookups);
+	fprintf(out, "count.probes %lu\n", st->probes);
+	fprintf(out, "count.max_probe %lu\n", st->max_probe);
+	fprintf(out, "bytes.allocated %lu\n", (unsigned long) st->allocated);
+	fprintf(out, "bytes.written %lu\n\n", (unsigned long) st->written);
+	funlockfile(out);
+}
+
+/**
+ * Adds the searches made in a symbol table.
+ */
+static void add_table(struct trans_stats *st, const struct symbol_table *tbl){
+	st->lookups += tbl->lookups;
+	st->probes += tbl->probes;
+	if(tbl->max_probe > st->max_probe)
+		st->max_probe = tbl->max_probe;
+}
@@ -0,0 +1,64 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+// Phases
+// The parts of a translation the -t report times separately
+#define PHASE_READ		0	// opening the input, see open_source()
+#define PHASE_PARSE		1	// reading every line, see process_token()
+#define PHASE_OPTIMIZE	2	// the peephole pass, only with -O
+#define PHASE_RESOLVE	3	// translating what still names a symbol
+#define PHASE_WRITE		4	// write_terms()
+#define PHASE_WARN		5	// check_warnings(), only with -w
+#define PHASE_CNT		6
+
+// Report Format
+// Every line is "<key> <value>"; a report starts with the version and is
+// followed by an empty line. Keys are only ever added, and the version goes
+// up if one changes meaning
+#define STATS_VERSION	1
+
+/**
+ * trans_stats
+ * What the -t report tells about one translation. Times are in seconds.
+ *
+ * double phase[]			The time spent in each phase (PHASE_*)
+ * double total				The time of the whole translation
+ * unsigned long lines		The number of source lines read
+ * unsigned long terms		The number of terms parsed
+ * unsigned long words		The number of words written
+ * unsigned long symbols	The number of labels, functions and constants
+ * unsigned long lookups	The number of symbol table searches
+ * unsigned long probes		The number of slots those searches looked at
+ * unsigned long max_probe	The most slots a single search looked at
+ * size_t allocated			The bytes of memory the translation took
+ * size_t written			The bytes of output produced
+ */
+struct trans_stats{
+	double phase[PHASE_CNT];
+	double total;
+	unsigned long lines;
+	unsigned long terms;
+	unsigned long words;
+	unsigned long symbols;
+	unsigned long lookups;
+	unsigned long probes;
+	unsigned long max_probe;
+	size_t allocated;
+	size_t written;
+};
+
+struct program;
+
+// Timing
+double stats_clock(void);
+double stats_lap(struct program *prog, int phase, double start);
+
+// Counters
+void collect_stats(struct program *prog);
+
+// Report
+void print_stats(struct program *prog);
+
+#endif
@@ -25,7 +25,7 @@
 void trimwhitespace(char *s){
 	char * p = s;
 	int l = strlen(p);
-	while(isspace(p[l - 1])) p[--l] = 0;
+	while(l && isspace(p[l - 1])) p[--l] = 0;
 	while(* p && isspace(* p)) ++p, --l;
 	memmove(s, p, l + 1);
 }
@@ -104,39 +104,6 @@ char *numtos(int num){
 	return number;
 }
 
-/**
- * Converts a base-10 (positive) integer to base-2. Note that the left most
- * bit is the most significant bit.
- * @param	num			The number to parse
- * @param	min_size	The minimum number of bits to show.
- * @return				The converted base-10 value.
- */
-char *numtob(int num, int min_size){
-	
-	// vars
-	char *bin = malloc(33);
-	memset(bin, '0', 33);
-	bin[32] = 0;
-	int pos = 31;
-
-	// reduce to base two
-	do{
-		if(num % 2)
-			bin[pos] = '1';
-		else
-			bin[pos] = '0';
-		pos--;
-	}while(num /= 2);
-	
-	// make the buffer as small as possible
-	min_size = min_size < 32 - pos ? 32 - pos : min_size;
-	char *ret_bin = malloc(min_size + 1);
-	memset(ret_bin, '0', min_size);
-	ret_bin[min_size] = 0;
-	memcpy(ret_bin + (min_size - (32 - pos) + 1), bin + pos + 1, min_size + 1);
-	return ret_bin;
-}
-
 /**
  * Returns the number of digits in the given number.
  *
@@ -188,3 +155,26 @@ int ctod(char c){
 	return c >= 0 && c <= 9 ? -1 : c - '0';
 }
 
+/**
+ * Reads a comma separated list of values, e.g. "3,0,127".
+ *
+ * @param	arg		The list to read.
+ * @param	vals	Where to put the values.
+ * @param	max		The most values that fit in vals.
+ * @param	max_val	The largest value allowed.
+ * @return			The number of values read, or -1 if one is malformed, out
+ * 					of range, or there are more than max of them.
+ */
+int read_values(const char *arg, unsigned char *vals, int max, int max_val){
+	int n = 0;
+	char *end;
+	while(*arg && n < max){
+		long v = strtol(arg, &end, 10);
+		if(end == arg || v < 0 || v > max_val || (*end && *end != ','))
+			return -1;
+		vals[n++] = v;
+		arg = *end ? end + 1 : end;
+	}
+	return *arg ? -1 : n;
+}
+
@@ -26,11 +26,12 @@ short check_EOF(FILE *file);
 // Number To String/Char conversion functions
 char dtoc(const int d);
 char *numtos(const int num);
-char *numtob(int num, int min_size);
 
 // String/Char to Number conversion functions
 int stonum(char *s);
 int ctod(char c);
+int read_values(const char *arg, unsigned char *vals, int max,
+		int max_val);
 
 // Number functions
 int numd(int num);
@@ -12,20 +12,39 @@
 #include <stdlib.h>
 #include "symbols.h"
 #include "idents.h"
+#include "generrors.h"
 #include "strlib.h"
+#include "arena.h"
 
+static void *sym_alloc(struct symbol_table *tbl, size_t size);
+static void insert_slot(struct symbol *sym, struct symbol_table *tbl);
+static void grow_slots(struct symbol_table *tbl);
+
+/**
+ * Adds a new symbol to the end of the given table. The identifier is copied
+ * into storage owned by the symbol, so callers are free to pass a token that
+ * still lives in the line buffer.
+ */
 void add_symbol(char *iden, int val, struct symbol_table *tbl, int pos, 
 		short type){
 	if(!tbl)
 		return;
+
+	// keep the table at most half full so probe runs stay short
+	if((tbl->sym_count + 1) * 2 > tbl->slot_count)
+		grow_slots(tbl);
 	
-	struct symbol *sym = (struct symbol *) malloc(sizeof(struct symbol));
-	sym->iden = iden;
+	struct symbol *sym = (struct symbol *) sym_alloc(tbl, 
+			sizeof(struct symbol));
+	sym->iden = (char *) sym_alloc(tbl, strlen(iden) + 1);
+	strcpy(sym->iden, iden);
+	sym->hash = hash_iden(iden);
 	sym->val = val;
 	sym->next = 0;
 	sym->pos = pos;
 	sym->used = 0;
 	sym->type = type;
+	sym->ord = tbl->sym_count;
 
 
 	if(tbl->r){
@@ -36,46 +55,160 @@ void add_symbol(char *iden, int val, struct symbol_table *tbl, int pos,
 		tbl->r = sym;
 		tbl->e = sym;
 	}
+	tbl->sym_count++;
+	insert_slot(sym, tbl);
+}
+
+/**
+ * FNV-1a hash of an identifier string.
+ */
+unsigned int hash_iden(const char *iden){
+	unsigned int h = 2166136261u;
+	while(*iden){
+		h ^= (unsigned char) *iden++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Places the symbol in the first free slot along its probe sequence. An
+ * identifier that is already present keeps its earlier slot, so lookups
+ * still return the first definition like the list walk did.
+ */
+static void insert_slot(struct symbol *sym, struct symbol_table *tbl){
+	unsigned int mask = tbl->slot_count - 1;
+	unsigned int i = sym->hash & mask;
+	while(tbl->slots[i])
+		i = (i + 1) & mask;
+	tbl->slots[i] = sym;
+}
+
+/**
+ * Doubles the slot array (or creates it) and re-indexes every symbol in
+ * insertion order.
+ */
+static void grow_slots(struct symbol_table *tbl){
+	unsigned int count = tbl->slot_count ? tbl->slot_count * 2 
+			: SYM_SLOTS_INIT;
+	if(!tbl->mem)
+		free(tbl->slots);
+	tbl->slots = (struct symbol **) sym_alloc(tbl, 
+			count * sizeof(struct symbol *));
+	tbl->slot_count = count;
+
+	struct symbol *sym = tbl->r;
+	while(sym){
+		insert_slot(sym, tbl);
+		sym = sym->next;
+	}
+}
+
+/**
+ * Allocates zeroed memory from the table's arena, or the heap if the table
+ * has none.
+ */
+static void *sym_alloc(struct symbol_table *tbl, size_t size){
+	if(tbl->mem)
+		return arena_alloc(tbl->mem, size);
+	return calloc(1, size);
 }
 
 struct symbol *find_symbol(char *iden, struct symbol_table *tbl){
 	if(!iden)
 		return 0;
-	if(!tbl)
+	if(!tbl || !tbl->slots)
 		return 0;
 	
-	struct symbol *sym = tbl->r;
-	while(sym && strcmp(sym->iden, iden)){
-		sym = sym->next;
+	unsigned int h = hash_iden(iden);
+	unsigned int mask = tbl->slot_count - 1;
+	unsigned int i = h & mask;
+	unsigned int probe = 1;
+	struct symbol *sym;
+	while( (sym = tbl->slots[i]) ){
+		if(sym->hash == h && !strcmp(sym->iden, iden))
+			break;
+		i = (i + 1) & mask;
+		probe++;
 	}
+
+	// for the -t report
+	tbl->lookups++;
+	tbl->probes += probe;
+	if(probe > tbl->max_probe)
+		tbl->max_probe = probe;
 	return sym;
 }
 
-struct symbol *find_symbol_at(int pos, struct symbol_table *tbl){
-	if(pos < 0)
-		return 0;
-	if(!tbl)
-		return 0;
+/**
+ * Orders symbols by position, falling back to insertion order so that of
+ * two symbols at one position the one declared first comes first.
+ */
+static int cmp_sym_pos(const void *a, const void *b){
+	const struct symbol *sa = *(const struct symbol **) a;
+	const struct symbol *sb = *(const struct symbol **) b;
+	if(sa->pos != sb->pos)
+		return sa->pos < sb->pos ? -1 : 1;
+	return sa->ord - sb->ord;
+}
 
+/**
+ * Builds a position-sorted index over all symbols in the table. This is
+ * meant to be done once parsing has finished and every label/function has
+ * been given its final position.
+ *
+ * @param	tbl		The table to index.
+ * @param	idx		Filled with the sorted symbols, cursor at the start.
+ */
+void build_pos_index(struct symbol_table *tbl, struct symbol_index *idx){
+	idx->syms = 0;
+	idx->count = 0;
+	idx->cur = 0;
+	if(!tbl || !tbl->sym_count)
+		return;
+
+	idx->syms = (struct symbol **) sym_alloc(tbl, tbl->sym_count * 
+			sizeof(struct symbol *));
 	struct symbol *sym = tbl->r;
-	while(sym && sym->pos != pos){
+	while(sym){
+		idx->syms[idx->count++] = sym;
 		sym = sym->next;
 	}
-	return sym;
+	qsort(idx->syms, idx->count, sizeof(struct symbol *), cmp_sym_pos);
+}
+
+/**
+ * Advances a cursor through the index to the next symbol placed before the
+ * term at a position, i.e. given a smaller one. Symbols that were never
+ * placed are passed over. Successive calls must be made with non-decreasing
+ * positions.
+ *
+ * @param	pos		The position of the term.
+ * @param	idx		A position index made by build_pos_index().
+ * @return			The next symbol placed before pos, otherwise 0.
+ */
+struct symbol *next_symbol_before(int pos, struct symbol_index *idx){
+	struct symbol *sym;
+	while(idx->cur < idx->count && idx->syms[idx->cur]->pos < pos){
+		sym = idx->syms[idx->cur++];
+		if(sym->pos >= 0)
+			return sym;
+	}
+	return 0;
 }
 
-void print_symbol(struct symbol *sym, int c){
+void print_symbol(struct symbol *sym, int c, FILE *out){
 
 	if(c > -1)
-		printf(	"\t== Symbol %d ==\n", c);
+		fprintf(out, "\t== Symbol %d ==\n", c);
 	else
-		printf(	"\t== Symbol ==\n");
+		fprintf(out, "\t== Symbol ==\n");
 
 	if(!sym){
-		printf("** NULL **\n");
+		fprintf(out, "** NULL **\n");
 	}
 	else{
-		printf(	"Next:\t%p\n"
+		fprintf(out, "Next:\t%p\n"
 				"Iden:\t%s\n"
 				"Val:\t%d\n"
 				"Type:\t%d\n"
@@ -84,55 +217,41 @@ void print_symbol(struct symbol *sym, int c){
 	}
 }
 
-void print_symbols(struct symbol_table *tbl){
+void print_symbols(struct symbol_table *tbl, FILE *out){
 	
 	int i = 0;
 
-	printf(	"\t\t==== Symbol Table ====\n");
+	fprintf(out, "\t\t==== Symbol Table ====\n");
 	if(!tbl){
-		printf("** NULL **\n");
+		fprintf(out, "** NULL **\n");
 	}
 	else{
 		struct symbol *sym = tbl->r;
 		while(sym){
-			print_symbol(sym, i++);
+			print_symbol(sym, i++, out);
 			sym = sym->next;
 		}
 	}
 }
 
 void print_symbol_not_found(const char *bad_sym, struct program *prog){
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "%s:\n", prog->input);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tUnknown Symbol '%s'.\n", bad_sym);
-	prog->error_code = BAD_SYM; // TODO: create actual error_code 
-
+	report_at(prog, DIAG_ERROR, BAD_SYM, NO_LINE, "Unknown Symbol '%s'.", 
+			bad_sym); // TODO: create actual error_code 
 }
 
-
 void print_symbol_not_used(const struct symbol *sym, const char *sym_type, 
-		const struct program *prog){
-	print_asterisk(YLW_C, stderr);
-	fprintf(stderr, "%s, %d:\n", prog->input, sym->pos);
-	print_asterisk(YLW_C, stderr);
-	fprintf(stderr, "\tWarning: %s '%s' is not used.\n", sym_type, sym->iden);
+		struct program *prog){
+	report_at(prog, DIAG_WARNING, 0, sym->pos, "%s '%s' is not used.",
+			sym_type, sym->iden);
 }
 
 void print_non_func_call(const struct symbol *sym, struct program *prog,
 		int err_line){
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "%s, %d:\n", prog->input, err_line);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tUnable to call a non-function, '%s'!\n", sym->iden);
-	prog->error_code = CALL_NON_F;
+	report_at(prog, DIAG_ERROR, CALL_NON_F, err_line, 
+			"Unable to call a non-function, '%s'!", sym->iden);
 }
 
 void print_return_from_non_func(int abs_pos, struct program *prog){
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "%s, %d:\n", prog->input, abs_pos);
-	print_asterisk(RED_C, stderr);
-	fprintf(stderr, "\tUnable to return without a function declared first!\n");
-	prog->error_code = RET_NON_F;
+	report_at(prog, DIAG_ERROR, RET_NON_F, abs_pos, 
+			"Unable to return without a function declared first!");
 }
-
@@ -9,12 +9,72 @@
 #define LABEL_TYPE	1
 #define FUNC_TYPE	2
 
+// Hash Table Sizing
+#define SYM_SLOTS_INIT	64	// must be a power of two
+
+#include "source.h"
+#include "terms.h"
+#include "stats.h"
+
 struct Term;
+struct arena;
 
+/**
+ * symbol_table
+ * struct symbol *r			The first symbol added, for in-order walking
+ * struct symbol *e			The last symbol added
+ * int sym_count			The number of symbols held
+ * struct symbol **slots	Open-addressed (linear probe) index over the
+ * 							symbols, keyed by the hash of the identifier
+ * unsigned int slot_count	The size of slots, always a power of two
+ * struct arena *mem		Where symbols and slots are allocated, 0 to use
+ * 							malloc
+ * unsigned long lookups	The number of searches made, for the -t report
+ * unsigned long probes		The number of slots those searches looked at
+ * unsigned int max_probe	The most slots a single search looked at
+ */
 struct symbol_table{
 	struct symbol *r;
 	struct symbol *e;
 	int sym_count;
+	struct symbol **slots;
+	unsigned int slot_count;
+	struct arena *mem;
+	unsigned long lookups;
+	unsigned long probes;
+	unsigned int max_probe;
+};
+
+/**
+ * symbol_index
+ * struct symbol **syms		The symbols of a table sorted by position, ties
+ * 							kept in insertion order
+ * int count				The number of symbols in syms
+ * int cur					Cursor for walking positions in increasing order
+ */
+struct symbol_index{
+	struct symbol **syms;
+	int count;
+	int cur;
+};
+
+/**
+ * fixup_list
+ * What a one pass translation keeps about operands that name symbols not
+ * defined yet, so their words can be filled in once they are (see fixups.c).
+ *
+ * struct symbol_table pending	One entry per symbol waited on; its val is
+ * 								the position of the first term waiting, see
+ * 								the fixups of a term_table
+ * struct symbol *cur_func		The last function placed, which a return
+ * 								goes back to
+ * int fault					The position of the first term that can't be
+ * 								translated, 0 if none
+ */
+struct fixup_list{
+	struct symbol_table pending;
+	struct symbol *cur_func;
+	int fault;
 };
 
 typedef struct symbol{
@@ -25,21 +85,48 @@ typedef struct symbol{
 	int pos;
 	short used;
 	short type;
+	unsigned int hash;
+	int ord;
 }symbol;
 
+/**
+ * options
+ * Settings chosen on the command line, kept per translation so that several
+ * translations can run at once.
+ */
+struct options{
+	short warnings;
+	short print_tables;
+	short print_comp_i;
+	short make_fast;
+	short atomic_out;
+	short out_format;
+	short quiet;
+	short optimize;
+	short timings;
+};
+
 struct program{
+	struct options opts;
 	FILE *out;
 	FILE *in;
+	FILE *msg;
+	FILE *err;
 	char *input;
-	fpos_t str_line;
-	unsigned short line_count;
-	unsigned int term_count;
+	struct source src;
+	unsigned int line_count;
 	short error_code;
 	char *err_str;
 	struct symbol_table *tbl;
 	struct symbol_table *const_tbl;
-	struct Term * terms;
-	struct Term *end_term;
+	struct symbol_index pos_idx;
+	struct fixup_list fix;
+	struct term_table terms;
+	struct trans_stats stats;
+	struct arena *mem;
+	struct diag_list *diags;
+	unsigned char *image;
+	size_t image_len;
 };
 
 // Symbol manipulation
@@ -47,17 +134,21 @@ void add_symbol(char *iden, int val, struct symbol_table *tbl, int pos,
 		short type);
 
 // Symbol searching
+unsigned int hash_iden(const char *iden);
 struct symbol *find_symbol(char *iden, struct symbol_table *tbl);
-struct symbol *find_symbol_at(int pos, struct symbol_table *tbl);
+
+// Position index
+void build_pos_index(struct symbol_table *tbl, struct symbol_index *idx);
+struct symbol *next_symbol_before(int pos, struct symbol_index *idx);
 
 // Printing of symbols
-void print_symbol(struct symbol *sym, int c);
-void print_symbols(struct symbol_table *tbl);
+void print_symbol(struct symbol *sym, int c, FILE *out);
+void print_symbols(struct symbol_table *tbl, FILE *out);
 
 // Error handling
 void print_symbol_not_found(const char *bad_sym, struct program *prog);
 void print_symbol_not_used(const struct symbol *sym, const char *sym_type, 
-		const struct program *prog);
+		struct program *prog);
 void print_non_func_call(const struct symbol *sym, struct program *prog,
 		int err_line);
 void print_return_from_non_func(int abs_pos, struct program *prog);
@@ -9,13 +9,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include "terms.h"
 #include "generrors.h"
+#include "symbols.h"
+#include "arena.h"
+#include "trace.h"
 
 
 /**
  * Automatically adds the child to the parent term, adding it to the next
- * available slot.  Note that this function already expects
+ * available slot.  The child array lives in the program's arena, so growing
+ * it means copying into a fresh, larger array.
  */
 void add_child_term(struct Term *child, struct Term *parent, 
 		struct program *prog){
@@ -23,8 +28,8 @@ void add_child_term(struct Term *child, struct Term *parent,
 	// just in case...
 	if(!parent->child_terms){
 		parent->child_terms = 
-				(struct Term **) malloc(4 * sizeof(struct Term*));
-		memset(parent->child_terms, 0, 4);
+				(struct Term **) arena_alloc(prog->mem, 
+				4 * sizeof(struct Term*));
 		parent->child_count = 4;
 	}
 
@@ -38,29 +43,34 @@ void add_child_term(struct Term *child, struct Term *parent,
 		parent->child_terms[i] = child;
 	else{
 		// resize, add to end
-		parent->child_terms = (struct Term **) realloc(parent->child_terms,
-				(parent->child_count * .75) * sizeof(struct Term*));
-		parent->child_terms[parent->child_count] = child;
-		parent->child_count = parent->child_count * .75;
+		struct Term **grown = (struct Term **) arena_alloc(prog->mem,
+				parent->child_count * 2 * sizeof(struct Term*));
+		memcpy(grown, parent->child_terms, 
+				parent->child_count * sizeof(struct Term*));
+		grown[parent->child_count] = child;
+		parent->child_terms = grown;
+		parent->child_count = parent->child_count * 2;
 	}
 }
 
-struct Term* create_term(char* term, unsigned int term_len, int children){
-	struct Term * new_term = (struct Term *) malloc(sizeof(struct Term));
+/**
+ * Creates a new term in the given arena, copying term_len characters of term
+ * as its string. Children slots start out empty.
+ */
+struct Term* create_term(const char* term, unsigned int term_len, int children,
+		struct arena *mem){
+	struct Term * new_term = (struct Term *) arena_alloc(mem, 
+			sizeof(struct Term));
 	if(!new_term){
-		#ifdef DEBUG
-			fprintf(stderr, "NEW TERM IS NUL.\n");
-		#endif
+		TRACE(0, TRACE_PARSE, TRACE_PHASE, "out of memory for a term");
+		return 0;
 	}
 	new_term->trans = 0;
 	new_term->child_count = children;
-	new_term->term = (char *) malloc(term_len+1);
-	strncpy(new_term->term, term, term_len);
-	new_term->term[term_len] = '\0';
+	new_term->term = arena_strndup(mem, term, term_len);
 	if(children){
-		new_term->child_terms = 
-				(struct Term **) malloc(children * sizeof(struct Term*));
-		memset(new_term->child_terms, 0, children);
+		new_term->child_terms = (struct Term **) arena_alloc(mem, 
+				children * sizeof(struct Term*));
 	}
 	else{
 		new_term->child_terms = 0;
@@ -68,23 +78,96 @@ struct Term* create_term(char* term, unsigned int term_len, int children){
 	return new_term;
 }
 
-struct Term* create_single_char_term(const char term, int children){
-	struct Term * new_term = (struct Term *) malloc(sizeof(struct Term));
-	new_term->trans = 0;
-	new_term->child_count = children;
-	new_term->term = (char *) malloc(2);
-	new_term->term[1] = '\0';
-	new_term->term[0] = term;
-	if(children){	
-		new_term->child_terms = 
-				(struct Term **) malloc(children * sizeof(struct Term*));
-		memset(new_term->child_terms, 0, children);
-	}
-	else{
-		new_term->child_terms = 0;
+struct Term* create_single_char_term(const char term, int children,
+		struct arena *mem){
+	return create_term(&term, 1, children, mem);
+}
+
+/**
+ * Adds a term to the end of a table, making room for it as needed.
+ *
+ * @param	tt		The table.
+ * @param	ref		What the term names, copied into mem, or 0 for nothing.
+ * @param	kind	What is left to do for its word (TERM_*).
+ * @param	line	The source line it was read on.
+ * @param	mem		Where the copy of ref is kept.
+ * @return			The position of the new term, or 0 if memory ran out.
+ */
+int add_term(struct term_table *tt, const char *ref, int kind, int line,
+		struct arena *mem){
+	int i = tt->count + 1;
+	if(i >= tt->size){
+		int size = tt->size ? tt->size * 2 : TERMS_INIT;
+		unsigned char *words = (unsigned char *) realloc(tt->words, size);
+		short *ops = (short *) realloc(tt->ops, size * sizeof(short));
+		unsigned char *kinds = (unsigned char *) realloc(tt->kinds, size);
+		int *lines = (int *) realloc(tt->lines, size * sizeof(int));
+		char **refs = (char **) realloc(tt->refs, size * sizeof(char *));
+		int *fixups = (int *) realloc(tt->fixups, size * sizeof(int));
+
+		// whatever did move is kept, so the table can still be freed
+		if(words)	tt->words = words;
+		if(ops)		tt->ops = ops;
+		if(kinds)	tt->kinds = kinds;
+		if(lines)	tt->lines = lines;
+		if(refs)	tt->refs = refs;
+		if(fixups)	tt->fixups = fixups;
+		if(!words || !ops || !kinds || !lines || !refs || !fixups)
+			return 0;
+		tt->size = size;
 	}
-	return new_term;
+
+	char *copy = arena_strndup(mem, ref ? ref : "", ref ? strlen(ref) : 0);
+	if(!copy)
+		return 0;
+	tt->words[i] = 0;
+	tt->ops[i] = -1;
+	tt->kinds[i] = kind;
+	tt->lines[i] = line;
+	tt->refs[i] = copy;
+	tt->fixups[i] = 0;
+	tt->count = i;
+	return i;
 }
 
+/**
+ * Packs the low len bits of val into the word of a term, directly after the
+ * bits of the newest instruction that have already been filled in.
+ *
+ * @param	tt			The table.
+ * @param	i			The position of the term, the newest instruction.
+ * @param	val			The value to add.
+ * @param	len			How many bits of val to use.
+ * @param	word_size	The number of bits in a word.
+ */
+void add_word_bits(struct term_table *tt, int i, int val, int len, 
+		int word_size){
+	tt->words[i] |= (val & ((1 << len) - 1)) << (word_size - tt->bits - len);
+	tt->bits += len;
+}
 
+/**
+ * Copies a term to another position, as when closing up a gap.
+ */
+void move_term(struct term_table *tt, int to, int from){
+	tt->words[to] = tt->words[from];
+	tt->ops[to] = tt->ops[from];
+	tt->kinds[to] = tt->kinds[from];
+	tt->lines[to] = tt->lines[from];
+	tt->refs[to] = tt->refs[from];
+	tt->fixups[to] = tt->fixups[from];
+}
 
+/**
+ * Frees the arrays of a table, leaving it empty. The strings of refs live in
+ * the arena they were added with.
+ */
+void free_term_table(struct term_table *tt){
+	free(tt->words);
+	free(tt->ops);
+	free(tt->kinds);
+	free(tt->lines);
+	free(tt->refs);
+	free(tt->fixups);
+	memset(tt, 0, sizeof(struct term_table));
+}
@@ -19,12 +19,63 @@ struct Term{
 	struct Term *next_term;
 };
 
+// Term Kinds
+// What is still to be done to the word of a term in a term_table
+#define TERM_DONE		0	// the word is final
+#define TERM_REF		1	// names a label, constant or literal, see refs
+#define TERM_SLOT		2	// left empty for its instruction to fill in
+
+// Term Table Sizing
+#define TERMS_INIT		64	// entries, doubled as needed
+
+/**
+ * term_table
+ * The terms of a translated program, one per word of the text ring, held as
+ * parallel arrays indexed by position. Positions start at 1, entry 0 is
+ * unused, and a label at position p sits directly before the term at p + 1.
+ *
+ * unsigned char *words		The encoded word of each term
+ * short *ops				The opcode table index of an instruction,
+ * 							otherwise -1
+ * unsigned char *kinds		What is left to do for the word (TERM_*)
+ * int *lines				The source line each term was read on
+ * char **refs				What an operand names, as written, "" if nothing
+ * int *fixups				The next term waiting on the same symbol, 0 at
+ * 							the end of the list (see fixups.c)
+ * int bits					How many (high) bits of the newest instruction's
+ * 							word have been filled in
+ * int count				The number of terms
+ * int size					The room in every array, entry 0 included
+ */
+struct term_table{
+	unsigned char *words;
+	short *ops;
+	unsigned char *kinds;
+	int *lines;
+	char **refs;
+	int *fixups;
+	int bits;
+	int count;
+	int size;
+};
+
 struct program;
+struct arena;
 
 // Term Manipulation Functions
 void 	add_child_term(struct Term *c, struct Term *t, struct program *prog);
-struct Term* 	create_term(char* term, unsigned int term_len, int children);
-struct Term* 	create_single_char_term(const char term, int children);
+struct Term* 	create_term(const char* term, unsigned int term_len, int children,
+		struct arena *mem);
+struct Term* 	create_single_char_term(const char term, int children,
+		struct arena *mem);
+
+// Term Table Functions
+int 	add_term(struct term_table *tt, const char *ref, int kind, int line,
+		struct arena *mem);
+void 	add_word_bits(struct term_table *tt, int i, int val, int len, 
+		int word_size);
+void 	move_term(struct term_table *tt, int to, int from);
+void 	free_term_table(struct term_table *tt);
 
 
 
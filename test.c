@@ -4,24 +4,61 @@
  * Date:		Mar 2012
  *
  * Description:	A testing suite for comparing program output against
- * 				pre-generated test results.
+ * 				pre-generated test results.  By default the translator is
+ * 				linked in and every test is translated in memory; with -e the
+ * 				translator executable is run once per test instead.
  *
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <wait.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "translator.h"
+#include "symbols.h"
+#include "source.h"
+#include "opcodes.h"
+#include "machine.h"
+#include "image.h"
 #include "test.h"
 #include "strlib.h"
 
 /**
  * Main testing driver; runs all input tests and compares to output files.
+ *
+ * Usage: test [-e] [-j jobs]
  */
 int main(int argc, char **argv){
 
+	// the number of tests allowed to run at once defaults to the CPU count
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	short exec = 0, bad = 0;
+	if(jobs < 1)
+		jobs = MAX_JOBS;
+	for(int c = 1; c < argc; c++){
+		if(!strcmp(argv[c], EXEC_FLAG))
+			exec = 1;
+		else if(!strcmp(argv[c], JOBS_FLAG) && c + 1 < argc)
+			bad |= (jobs = strtol(argv[++c], 0, 10)) < 1;
+		else
+			bad = 1;
+	}
+	if(bad){
+		fprintf(stderr, "Usage: %s [%s] [%s jobs]\n", argv[0], EXEC_FLAG,
+				JOBS_FLAG);
+		exit(1);
+	}
+
 	// Print some banner for whatever reason
 	printf("\t\t===== Translator Testing =====\n");
 
@@ -29,46 +66,158 @@ int main(int argc, char **argv){
 	print_status(WHT_C, 0, stdout);
 	printf("Performing clean-up from previous tests...\n");
 	cleanup_older();
+	if(exec){
+		print_status(WHT_C, 0, stdout);
+		printf("Checking executable...\n");
+		if(check_executable())
+			exit(1);
+	}
+	else if(compile_formats()){
+		print_status(RED_C, 0, stderr);
+		fprintf(stderr, "Malformed instruction format in the translator!\n");
+		exit(1);
+	}
 	print_status(WHT_C, 0, stdout);
-	printf("Checking executable...\n");
-	if(check_executable())
+	printf("Checking binary images...\n");
+	if(check_image_coding())
+		exit(1);
+
+	// Find every test in the input folder
+	struct test *tests;
+	int test_cnt = discover_tests(&tests);
+	if(test_cnt < 0)
 		exit(1);
+	for(int i = 0; i < test_cnt; i++)
+		tests[i].skipped = check_files(tests[i].name);
 	print_status(GRN_C, 0, stdout);
-	printf("Ready! Running all tests!\n");
+	printf("Ready! Running all %d tests %s, %ld at a time!\n", test_cnt,
+			exec ? "with " TRANS_EXEC : "in-process", jobs);
+	fflush(stdout);
 
-	// Run all available tests
-	int test_num = 0;
+	// Run all available tests, then compare them in order
+	if(exec)
+		run_all_tests(TRANS_EXEC, tests, test_cnt, jobs);
+	else
+		run_in_process(tests, test_cnt, jobs);
 	int total_failed = 0;
-	while(test_num < TEST_CNT){
-		test_num++;
-		printf("\n\t--- Test Input #%d ---\n", test_num);
-		if(check_files(test_num))
+	for(int i = 0; i < test_cnt; i++){
+		printf("\n\t--- Test Input %s ---\n", tests[i].name);
+		if(tests[i].skipped){
+			print_test_failed();
+			total_failed++;
 			continue;
-		run_test(TRANS_EXEC, test_num);
-		total_failed += compare_results(test_num);
+		}
+		total_failed += compare_results(&tests[i], exec);
+		free_translation(&tests[i].res);
 	}
 
 	printf("\n\t\t===== Summary =====\n");
-	if(total_failed >= TEST_CNT *.5)
+	if(total_failed >= test_cnt *.5 && total_failed)
 		print_status(RED_C, 0, stdout);
 	else if(total_failed)
 		print_status(YLW_C, 0, stdout);
 	else
 		print_status(GRN_C, 0, stdout);
-	printf("%d of %d tests failed.\n", total_failed, TEST_CNT);
+	printf("%d of %d tests failed.\n", total_failed, test_cnt);
 
 	print_status(WHT_C, 0, stdout);
 	printf("Test Complete.\n");
+	free(tests);
+	return total_failed != 0;
+}
+
+/**
+ * Orders tests by their numeric suffix, falling back to the name for tests
+ * which share a number or have none.
+ */
+static int test_order(const void *a, const void *b){
+	const struct test *ta = a, *tb = b;
+	if(ta->num != tb->num)
+		return ta->num < tb->num ? -1 : 1;
+	return strcmp(ta->name, tb->name);
+}
+
+/**
+ * Collects every file in the input folder whose name starts with the test
+ * prefix, sorted by test number.
+ *
+ * @param	tests	Set to a newly allocated array of the discovered tests.
+ * @return			The number of tests found, or -1 if the input folder
+ * 					could not be read or there wasn't enough memory.
+ */
+int discover_tests(struct test **tests){
+	DIR *dir = opendir(TEST_IN);
+	if(!dir){
+		print_status(RED_C, 0, stderr);
+		fprintf(stderr, "Unable to open '%s'!\n", TEST_IN);
+		return -1;
+	}
+
+	int count = 0, size = 16;
+	size_t prefix = strlen(TEST_FILE);
+	*tests = (struct test *) malloc(size * sizeof(struct test));
+	if(!*tests){
+		print_status(RED_C, 0, stderr);
+		fprintf(stderr, "Out of memory!\n");
+		closedir(dir);
+		return -1;
+	}
+	struct dirent *ent;
+	while((ent = readdir(dir))){
+		size_t len = strlen(ent->d_name);
+		if(len <= prefix || strncmp(ent->d_name, TEST_FILE, prefix))
+			continue;
+		if(len >= TEST_NAME_LEN){
+			print_status(YLW_C, 0, stderr);
+			fprintf(stderr, "Skipping '%s', the name is too long!\n",
+					ent->d_name);
+			continue;
+		}
+		if(count == size){
+			struct test *grown = (struct test *) realloc(*tests,
+					2 * size * sizeof(struct test));
+			if(!grown){
+				print_status(RED_C, 0, stderr);
+				fprintf(stderr, "Out of memory!\n");
+				free(*tests);
+				closedir(dir);
+				return -1;
+			}
+			*tests = grown;
+			size *= 2;
+		}
+		struct test *t = &(*tests)[count++];
+		memset(t, 0, sizeof(struct test));
+		strcpy(t->name, ent->d_name);
+		t->num = strtol(ent->d_name + prefix, 0, 10);
+		t->opt_diff = OPT_SAME;
+	}
+	closedir(dir);
+
+	qsort(*tests, count, sizeof(struct test), test_order);
+	return count;
 }
 
 /**
- * Checks to make sure all relevant files exist.
+ * Checks to make sure all relevant files exist.  Only the input and the
+ * expected binary output are required; missing stdout or stderr expectations
+ * just mean those streams aren't compared.
  *
- * @param test_num		Which tests to check exist.
+ * @param name			Which test to check exists.
  * @return				0 if the files exist and are readable, otherwise
  * 						1;
  */
-short check_files(int test_num){
+short check_files(const char *name){
+	char path[TEST_PATH_LEN];
+	const char *dirs[] = {TEST_IN, TEST_OUT};
+	for(int i = 0; i < 2; i++){
+		snprintf(path, TEST_PATH_LEN, "%s%s", dirs[i], name);
+		if(access(path, R_OK)){
+			print_status(RED_C, 0, stdout);
+			printf("Unable to read '%s'!\n", path);
+			return 1;
+		}
+	}
 	return 0;
 }
 
@@ -88,10 +237,27 @@ void print_status(const char *color, const char *indent, FILE *out){
 
 /**
  * Deletes older test result data so as not to confuse an older test result
- * with a new one.
+ * with a new one.  The results folder is created if it doesn't exist yet.
  */
 void cleanup_older(){
-	
+	if(mkdir(TEST_RES, 0770) && errno != EEXIST){
+		print_status(RED_C, 0, stderr);
+		fprintf(stderr, "Unable to create '%s'!\n", TEST_RES);
+		exit(1);
+	}
+
+	DIR *dir = opendir(TEST_RES);
+	if(!dir)
+		return;
+	char path[TEST_PATH_LEN + NAME_MAX];
+	struct dirent *ent;
+	while((ent = readdir(dir))){
+		if(strncmp(ent->d_name, TEST_FILE, strlen(TEST_FILE)))
+			continue;
+		snprintf(path, sizeof(path), "%s%s", TEST_RES, ent->d_name);
+		unlink(path);
+	}
+	closedir(dir);
 }
 
 /**
@@ -100,21 +266,75 @@ void cleanup_older(){
  * @return		0 on success, otherwise 1
  */
 short check_executable(){
+	if(access(TRANS_EXEC, X_OK)){
+		print_status(RED_C, 0, stderr);
+		fprintf(stderr, "'%s' is missing or not executable!\n", TRANS_EXEC);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Writes images of every length that fits on the text ring, in both
+ * encodings, and reads them back.  Most lengths leave part of the last byte
+ * of a packed image unused.  An image missing its last byte must be refused.
+ *
+ * @return		0 if every image read back as written, otherwise 1
+ */
+short check_image_coding(){
+	const int encodings[] = {IMG_BYTES, IMG_PACKED};
+	unsigned char words[MAX_MEMORY], back[MAX_MEMORY];
+	char buf[IMG_HEADER_SIZE + MAX_MEMORY];
+	struct image_header hdr;
+	size_t len;
+	long read;
+
+	for(int e = 0; e < 2; e++){
+		for(int count = 0; count <= MAX_MEMORY; count++){
+			for(int i = 0; i < count; i++)
+				words[i] = (i * 37 + count) & WORD_MASK;
+			len = write_image(buf, words, count, WORD_SIZE, MAX_MEMORY, 
+					encodings[e]);
+			read = read_image(buf, len, &hdr, back, MAX_MEMORY);
+			if(len != image_size(count, WORD_SIZE, encodings[e]) || 
+					read != count || hdr.word_count != (unsigned long) count
+					|| hdr.word_size != WORD_SIZE || 
+					hdr.encoding != encodings[e] || 
+					hdr.ring_size != MAX_MEMORY || 
+					memcmp(words, back, count) ||
+					read_image(buf, len - 1, &hdr, back, MAX_MEMORY) !=
+					(count ? IMG_TRUNCATED : IMG_BAD_MAGIC)){
+				print_status(RED_C, 0, stderr);
+				fprintf(stderr, "A %s image of %d words doesn't read back "
+						"as written!\n", e ? "packed" : "byte", count);
+				return 1;
+			}
+		}
+	}
 	return 0;
 }
 
 /**
- * Performs the test on the given exceutable and will wait until the test
- * completes before returning.
+ * Starts the test on the given executable in a child process and returns
+ * without waiting for it; the caller is responsible for reaping the child.
  *
  * @param	exec		The program to test against
- * @param	test_num	The numbered test to run against the executable.
+ * @param	name		The test to run against the executable.
+ * @return				The pid of the child running the test.
  */
-void run_test(char *exec, int test_num){
+pid_t run_test(char *exec, const char *name){
 	
-	int pid = 0, out, err;
-	char *outbuf, *errbuf, *inbuf, *resbuf;
-	char **prog;
+	pid_t pid = 0;
+	int out, err;
+	char outbuf[TEST_PATH_LEN], errbuf[TEST_PATH_LEN];
+	char inbuf[TEST_PATH_LEN], resbuf[TEST_PATH_LEN];
+	char *prog[4];
+
+	// results are named before forking so the child only has to open them
+	snprintf(outbuf, TEST_PATH_LEN, "%s%s.out", TEST_RES, name);
+	snprintf(errbuf, TEST_PATH_LEN, "%s%s.err", TEST_RES, name);
+	snprintf(inbuf, TEST_PATH_LEN, "%s%s", TEST_IN, name);
+	snprintf(resbuf, TEST_PATH_LEN, "%s%s.b", TEST_RES, name);
 	pid = fork();
 	
 	switch(pid){
@@ -128,32 +348,16 @@ void run_test(char *exec, int test_num){
 		case 0:
 			
 			// setup file redirects
-			outbuf = (char *) malloc(64);
-			memset(outbuf, 0, 64);
-			sprintf(outbuf, "%s%s%d.out", TEST_RES, TEST_FILE, test_num);
-			out = open(outbuf, O_WRONLY | O_CREAT, 0770);
+			out = open(outbuf, O_WRONLY | O_CREAT | O_TRUNC, 0770);
 			dup2(out, STDOUT_FILENO);
-			errbuf = (char *) malloc(64);
-			memset(errbuf, 0, 64);
-			sprintf(errbuf, "%s%s%d.err", TEST_RES, TEST_FILE, test_num);
-			err = open(errbuf, O_WRONLY | O_CREAT, 0770);
+			err = open(errbuf, O_WRONLY | O_CREAT | O_TRUNC, 0770);
 			dup2(err, STDERR_FILENO);
 			
 			// build arguments
-			prog = (char **) malloc(4 * sizeof(char *));
-			for(int i = 1; i < 3; i++){
-				prog[i] = (char *) malloc(4 * 4);
-			}
 			prog[0] = exec;
-			inbuf = (char *) malloc(64);
-			memset(inbuf, 0, 64);
-			sprintf(inbuf, "%s%s%d", TEST_IN, TEST_FILE, test_num);
 			prog[1] = inbuf;
-			resbuf = (char *) malloc(64);
-			memset(resbuf, 0, 64);
-			sprintf(resbuf, "%s%s%d.b", TEST_RES, TEST_FILE, test_num);
 			prog[2] = resbuf;
-			prog[3] = '\0'; // last argument must be nul
+			prog[3] = 0; // last argument must be nul
 			
 			// actually execute the test
 			execvp(prog[0], prog);
@@ -163,92 +367,495 @@ void run_test(char *exec, int test_num){
 			_exit(1);
 	}
 
-	// simply wait for the child to finish
-	waitpid(pid, 0, 0);
+	return pid;
 }
 
 /**
- * Does a line-by-line comparison of the expected output against the actual
- * output the program generated.
+ * Runs every test, keeping at most the given number of children alive at
+ * once.  Finished children are reaped with a non-blocking wait so new tests
+ * can be started as soon as a slot frees up.
  *
- * @param	test_num	The numbered test that we will compare.
- * @return				0 if the comparison found errors, otherwise 1.
+ * @param	exec		The program to test against
+ * @param	tests		The tests to run; their pid and status are filled in.
+ * @param	count		How many tests there are.
+ * @param	jobs		The most tests to run at the same time.
  */
-int compare_results(int test_num){
-
-	/*
-	char *outbuf = (char *) malloc(64);
-	memset(outbuf, 0, 64);
-	sprintf(outbuf, "%s%s%d.out", TEST_RES, TEST_FILE, test_num);
-	char *errbuf = (char *) malloc(64);
-	memset(errbuf, 0, 64);
-	sprintf(errbuf, "%s%s%d.err", TEST_RES, TEST_FILE, test_num);
-	*/
-
-	// Read from Example out
-	char *bbuf = (char *) malloc(64);
-	memset(bbuf, 0, 64);
-	sprintf(bbuf, "%s%s%d", TEST_OUT, TEST_FILE, test_num);
-	FILE *tres = fopen(bbuf, "r");
-
-	// Read from results of test
-	sprintf(bbuf, "%s%s%d.b", TEST_RES, TEST_FILE, test_num);
-	FILE *res = fopen(bbuf, "r");
-	if(!res){
-		print_status(RED_C, 0, stderr);
-		fprintf(stderr, "Unable to open '%s'!\n", bbuf);
+void run_all_tests(char *exec, struct test *tests, int count, int jobs){
+	int next = 0, running = 0;
+	struct timespec pause = {0, REAP_WAIT * 1000};
+
+	while(next < count || running){
+
+		// fill any free slots
+		while(next < count && running < jobs){
+			struct test *t = &tests[next++];
+			if(t->skipped)
+				continue;
+			t->pid = run_test(exec, t->name);
+			running++;
+		}
+
+		// collect whatever has finished, sleeping briefly if nothing has
+		int status;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if(pid == 0){
+			nanosleep(&pause, 0);
+			continue;
+		}
+		if(pid < 0){
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		for(int i = 0; i < next; i++){
+			if(tests[i].pid == pid){
+				tests[i].status = status;
+				tests[i].pid = 0;
+				running--;
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Runs every test through the linked in translator on a pool of threads,
+ * leaving each test's output in memory for compare_results().
+ *
+ * @param	tests		The tests to run; their results are filled in.
+ * @param	count		How many tests there are.
+ * @param	jobs		The number of threads to translate with.
+ */
+void run_in_process(struct test *tests, int count, int jobs){
+	struct test_pool pool;
+	pool.tests = tests;
+	pool.count = count;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, 0);
+
+	if(jobs > count)
+		jobs = count ? count : 1;
+	pthread_t *threads = (pthread_t *) malloc(jobs * sizeof(pthread_t));
+	int started = 0;
+	while(started < jobs){
+		if(pthread_create(&threads[started], 0, test_worker, &pool))
+			break;
+		started++;
+	}
+	if(!started)
+		test_worker(&pool);
+	for(int i = 0; i < started; i++)
+		pthread_join(threads[i], 0);
+	pthread_mutex_destroy(&pool.lock);
+	free(threads);
+}
+
+/**
+ * Worker thread body, translates tests off the pool until none are left.
+ * Each test is translated a second time with -O, and both are run to see
+ * that the peephole pass didn't change what the program does, then into
+ * both binary images to see that they hold the same words.
+ */
+void *test_worker(void *arg){
+	struct test_pool *pool = (struct test_pool *) arg;
+	struct options opts, opt_opts;
+	struct translation opt;
+	memset(&opts, 0, sizeof(struct options));
+	opts.out_format = OUT_TEXT;
+	opt_opts = opts;
+	opt_opts.optimize = 1;
+
+	char path[TEST_PATH_LEN];
+	struct source src;
+	int i;
+	while(1){
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if(i >= pool->count)
+			break;
+		struct test *t = &pool->tests[i];
+		if(t->skipped)
+			continue;
+
+		// name the input the same way the executable would see it
+		snprintf(path, TEST_PATH_LEN, "%s%s", TEST_IN, t->name);
+		FILE *in = fopen(path, "r");
+		if(!in || open_source(&src, in)){
+			if(in)
+				fclose(in);
+			t->skipped = 1;
+			continue;
+		}
+		fclose(in);
+		translate_memory(src.data, src.size, path, &opts, &t->res);
+		translate_memory(src.data, src.size, path, &opt_opts, &opt);
+		t->opt_diff = compare_optimized(&t->res, &opt);
+		free_translation(&opt);
+		t->img_diff = compare_images(src.data, src.size, path, &t->res);
+		close_source(&src);
+	}
+	return 0;
+}
+
+/**
+ * Compares all three results of a test, the compiled file, stdout, and
+ * stderr, against their expected versions.  In-process results that fail are
+ * written to the results folder so they can be looked at.  A test run by the
+ * executable also fails if it crashed or exited with an error.
+ *
+ * @param	t			The test that we will compare.
+ * @param	exec		Whether the results were written to files by the
+ * 						executable rather than kept in memory.
+ * @return				1 if the comparison found errors, otherwise 0.
+ */
+int compare_results(struct test *t, short exec){
+	const char *exp_dirs[] = {TEST_OUT, TEST_SOUT, TEST_SERR};
+	const char *res_exts[] = {".b", ".out", ".err"};
+	const char *whats[] = {"Compiled file", "Stdout", "Stderr"};
+	const char *bufs[] = {t->res.out, t->res.msg, t->res.err};
+	size_t lens[] = {t->res.out_len, t->res.msg_len, t->res.err_len};
+	char exp[TEST_PATH_LEN], res[TEST_PATH_LEN];
+	int failure = 0;
+
+	// the translator exits with 0 even when the source has errors
+	if(exec && (WIFSIGNALED(t->status) || WEXITSTATUS(t->status))){
+		print_status(RED_C, 0, stdout);
+		if(WIFSIGNALED(t->status))
+			printf("%s was killed by signal %d!\n", TRANS_EXEC,
+					WTERMSIG(t->status));
+		else
+			printf("%s exited with %d!\n", TRANS_EXEC,
+					WEXITSTATUS(t->status));
+		failure = 1;
+	}
+
+	for(int i = 0; i < 3; i++){
+
+		// only the compiled file has to have an expectation
+		snprintf(exp, TEST_PATH_LEN, "%s%s", exp_dirs[i], t->name);
+		if(i && access(exp, R_OK))
+			continue;
+		snprintf(res, TEST_PATH_LEN, "%s%s%s", TEST_RES, t->name, 
+				res_exts[i]);
+
+		struct source actual;
+		FILE *file = 0;
+		if(exec){
+			file = fopen(res, "r");
+			if(!file || open_source(&actual, file)){
+				print_status(RED_C, 0, stdout);
+				printf("Unable to open '%s'!\n", res);
+				if(file)
+					fclose(file);
+				failure = 1;
+				continue;
+			}
+		}
+		else
+			open_source_buffer(&actual, bufs[i], lens[i]);
+
+		if(compare_output(exp, &actual, whats[i], i > 0)){
+			failure = 1;
+			if(!exec)
+				save_result(res, bufs[i], lens[i]);
+		}
+		close_source(&actual);
+		if(file)
+			fclose(file);
+	}
+
+	if(!exec && t->opt_diff != OPT_SAME){
+		print_status(RED_C, 0, stdout);
+		if(t->opt_diff == OPT_ERRORS)
+			printf("Translating with -O changes whether it has errors!\n");
+		else if(t->opt_diff == OPT_NO_LOAD)
+			printf("The simulator can't load the output with and without "
+					"-O!\n");
+		else
+			printf("With -O, the run starting at $1=%d, $2=%d ends "
+					"differently!\n", t->opt_diff / (MAX_INT + 1),
+					t->opt_diff % (MAX_INT + 1));
+		failure = 1;
+	}
+
+	if(!exec && t->img_diff != OUT_TEXT){
+		print_status(RED_C, 0, stdout);
+		printf("The %s image doesn't hold (or load as) the words of the "
+				"text!\n", t->img_diff == OUT_BYTES ? "byte" : "packed");
+		failure = 1;
+	}
+
+	// summary of this test
+	if(failure)
 		print_test_failed();
+	else
+		print_test_success();
+	return failure;
+}
+
+/**
+ * Runs a machine like run_machine(), keeping track of which words of the
+ * data ring were last written by a call (STJ) rather than SW or SI.
+ *
+ * @param	m			The machine to run.
+ * @param	max_cycles	The most cycles to run for.
+ * @param	saved		Set for every data ring word a call wrote last.
+ * @return				RUN_HALTED, RUN_ILLEGAL or RUN_LIMIT.
+ */
+static int run_saving(struct machine *m, unsigned long max_cycles,
+		unsigned char *saved){
+	int ret, op, dp;
+	memset(saved, 0, MAX_CACHE);
+	while(m->cycles < max_cycles){
+		op = decode_word(m->text[m->tp]);
+		dp = m->dp;
+		if((ret = step_machine(m)) >= 0)
+			return ret;
+		if(op == OP_STJ || op == OP_SW || op == OP_SI)
+			saved[dp] = op == OP_STJ;
+	}
+	return RUN_LIMIT;
+}
+
+/**
+ * Runs the plain and the optimized translation of a test on the simulator,
+ * once for every pair of starting registers.  The peephole pass may change
+ * how many cycles a run takes, but not how it ends: a start that halts must
+ * halt with the same registers and data ring, and one that hits an illegal
+ * word must do so with both. Since the pass never adds cycles, a start the
+ * plain translation finishes within OPT_CYCLES must finish with -O too. A
+ * data ring word last written by a call holds how far the call was from its
+ * function, which the pass may change, so it isn't compared.
+ *
+ * @param	plain		The test translated without -O.
+ * @param	opt			The test translated with -O.
+ * @return				OPT_SAME (also if the plain one can't be run at
+ * 						all), OPT_ERRORS or OPT_NO_LOAD, or the first
+ * 						start that ended differently, as $1 * 128 + $2.
+ */
+int compare_optimized(const struct translation *plain, 
+		const struct translation *opt){
+	if(!plain->error_code != !opt->error_code)
+		return OPT_ERRORS;
+	if(plain->error_code)
+		return OPT_SAME;
+
+	struct machine base[2], m[2];
+	reset_machine(&base[0]);
+	reset_machine(&base[1]);
+	if(load_program(&base[0], plain->out, plain->out_len) < 0)
+		return OPT_SAME;
+	if(load_program(&base[1], opt->out, opt->out_len) < 0)
+		return OPT_NO_LOAD;
+
+	unsigned char saved[2][MAX_CACHE];
+	int res[2], d;
+	for(int i = 0; i < (MAX_INT + 1) * (MAX_INT + 1); i++){
+		for(int k = 0; k < 2; k++){
+			m[k] = base[k];
+			m[k].regs[0] = i / (MAX_INT + 1);
+			m[k].regs[1] = i % (MAX_INT + 1);
+			res[k] = run_saving(&m[k], OPT_CYCLES, saved[k]);
+		}
+		if(res[0] == RUN_LIMIT)
+			continue;
+		if(res[0] != res[1])
+			return i;
+		if(res[0] != RUN_HALTED)
+			continue;
+		if(m[0].dp != m[1].dp || memcmp(m[0].regs, m[1].regs, MAX_REGS))
+			return i;
+		for(d = 0; d < MAX_CACHE; d++){
+			if(m[0].data[d] != m[1].data[d] && !(saved[0][d] && saved[1][d]))
+				return i;
+		}
+	}
+	return OPT_SAME;
+}
+
+/**
+ * Decodes the text output of a translation, one word per line.
+ *
+ * @param	text		The translation.
+ * @param	words		Where to put the words.
+ * @param	max			How many words fit in words.
+ * @return				The number of words, or -1 if there are too many or a
+ * 						line isn't a word.
+ */
+static int text_words(const struct translation *text, unsigned char *words,
+		int max){
+	struct source src;
+	const char *s;
+	size_t n;
+	int count = 0;
+	open_source_buffer(&src, text->out, text->out_len);
+	while(next_line(&src)){
+		if(!(n = trimmed_line(&src, &s)))
+			continue;
+		if(n != WORD_SIZE || count == max)
+			return -1;
+		words[count] = 0;
+		for(size_t i = 0; i < n; i++)
+			words[count] = (words[count] << 1) | (s[i] == '1');
+		count++;
+	}
+	return count;
+}
+
+/**
+ * Translates a test into a byte image (-b) and a packed image (-p) and
+ * reads them back, checking that both hold the words of its text output.
+ * The simulator has to load all three onto the same text ring.
+ *
+ * @param	input		The test program.
+ * @param	size		The size of the test program.
+ * @param	name		The name to translate it under.
+ * @param	text		The test translated to text.
+ * @return				OUT_TEXT if both images held the same words, otherwise
+ * 						the format that didn't.
+ */
+int compare_images(const char *input, size_t size, const char *name,
+		const struct translation *text){
+	const int formats[] = {OUT_BYTES, OUT_PACKED};
+	struct options opts;
+	struct translation img;
+	struct image_header hdr;
+	struct machine m_text, m_img;
+	int count, diff = OUT_TEXT;
+	long read;
+
+	// a program too long for the text ring isn't checked
+	unsigned char words[MAX_MEMORY], back[MAX_MEMORY];
+	if(text->error_code || (count = text_words(text, words, MAX_MEMORY)) < 0)
+		return OUT_TEXT;
+	reset_machine(&m_text);
+	if(load_program(&m_text, text->out, text->out_len) != count)
+		return OUT_TEXT;
+	memset(&opts, 0, sizeof(struct options));
+	for(int f = 0; f < 2 && diff == OUT_TEXT; f++){
+		opts.out_format = formats[f];
+		translate_memory(input, size, name, &opts, &img);
+		read = read_image(img.out, img.out_len, &hdr, back, MAX_MEMORY);
+		reset_machine(&m_img);
+		if(img.error_code || read != count || 
+				hdr.word_count != (unsigned long) count ||
+				memcmp(words, back, count) ||
+				load_program(&m_img, img.out, img.out_len) != count ||
+				memcmp(&m_text, &m_img, sizeof(struct machine)))
+			diff = formats[f];
+		free_translation(&img);
+	}
+	return diff;
+}
+
+/**
+ * Does a line-by-line comparison of the expected output against the actual
+ * output the program generated.  Surrounding whitespace is ignored.
+ *
+ * @param	expected	The file holding the expected output.
+ * @param	actual		The output the test produced.
+ * @param	what		A name for the output, used in messages.
+ * @param	strip		Whether to ignore terminal color codes in the actual
+ * 						output.
+ * @return				1 if the comparison found errors, otherwise 0.
+ */
+int compare_output(const char *expected, struct source *actual, 
+		const char *what, short strip){
+
+	struct source want;
+	FILE *tres = fopen(expected, "r");
+	if(!tres || open_source(&want, tres)){
+		print_status(RED_C, 0, stdout);
+		printf("Unable to open '%s'!\n", expected);
+		if(tres)
+			fclose(tres);
 		return 1;
 	}
 
-	// setup some buffers for comparison
-	char *tline, *oline;
-	tline = (char *) malloc(64);
-	oline = (char *) malloc(64);
+	// actual lines are copied so color codes can be taken out of them
+	char *buf = 0;
+	size_t size = 0;
 	int line = 0;
 	int failure = 0;
 
 	// check each line
-	while(fgets(tline, 64, tres)){
-		fgets(oline, 64, res);
-		
-		// make sure the read went smoothly
-		if(feof(res)){
+	while(next_line(&want)){
+		if(!next_line(actual)){
 			print_status(RED_C, 0, stdout);
-			printf("Compiled file has fewer lines than expected!\n");
-			print_test_failed();
-			return 1;
+			printf("%s has fewer lines than expected!\n", what);
+			failure = 1;
+			break;
 		}
-		else if(ferror(res)){
-			print_status(RED_C, 0, stdout);
-			printf("Compiled file, '%s', had an error during "
-					"reading!\n", bbuf);
-			print_test_failed();
-			return 1;
+		if(actual->line_len + 1 > size){
+			size = actual->line_len + 1;
+			buf = (char *) realloc(buf, size);
 		}
+		memcpy(buf, actual->line, actual->line_len);
+		buf[actual->line_len] = '\0';
+		if(strip)
+			strip_colors(buf);
+		trimwhitespace(buf);
 
-		// clean up the lines first
-		trimwhitespace(tline);
-		trimwhitespace(oline);
-		
 		// equate lines
-		if(strcmp(tline, oline)){
+		const char *tline;
+		int tlen = (int) trimmed_line(&want, &tline);
+		if(strlen(buf) != (size_t) tlen || strncmp(tline, buf, tlen)){
 			print_status(RED_C, 0, stdout);
-			printf("Line %d:\texpected '%s', but read '%s'!\n", 
-					line+1, tline, oline);
+			printf("%s line %d:\texpected '%.*s', but read '%s'!\n", 
+					what, line+1, tlen, tline, buf);
 			failure = 1;
 		}
 		line++;
 	}
 
-	// summary of this test
-	if(failure)
-		print_test_failed();
-	else
-		print_test_success();
+	// anything left over in the result is unexpected
+	if(!failure && next_line(actual)){
+		print_status(RED_C, 0, stdout);
+		printf("%s has more lines than expected!\n", what);
+		failure = 1;
+	}
+
+	free(buf);
+	close_source(&want);
+	fclose(tres);
 	return failure;
 }
 
+/**
+ * Writes the output of an in-process test to the results folder.
+ */
+void save_result(const char *path, const char *buf, size_t len){
+	FILE *out = fopen(path, "w");
+	if(!out)
+		return;
+	fwrite(buf, 1, len, out);
+	fclose(out);
+}
+
+/**
+ * Removes terminal color escape sequences (ESC '[' ... 'm') from a line, so
+ * expected output can be written as plain text.
+ *
+ * @param	line	The line to clean up, modified in place.
+ */
+void strip_colors(char *line){
+	char *out = line;
+	while(*line){
+		if(line[0] == '\033' && line[1] == '['){
+			char *end = line + 2;
+			while(*end && *end != 'm')
+				end++;
+			if(*end == 'm'){
+				line = end + 1;
+				continue;
+			}
+		}
+		*out++ = *line++;
+	}
+	*out = '\0';
+}
+
 /**
  * A convenience function for indicating the test failed.
  */
@@ -1,6 +1,9 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <sys/types.h>
+#include <pthread.h>
+
 // Folder locations for output comparison, input files
 #define TEST_IN		"test_input/"
 #define TEST_OUT	"test_output/"
@@ -8,23 +11,98 @@
 #define TEST_SERR	"test_stderr/"
 #define TEST_RES	"test_results/"
 
-// The file name for all tests
+// The file name prefix for all tests; every file in TEST_IN starting with it
+// is treated as a test
 #define TEST_FILE	"test."
 
-// The highest test number (generally the range is the set of natural numbers)
-#define TEST_CNT	7
+// The longest test name we accept, and the longest path built from one
+#define TEST_NAME_LEN	64
+#define TEST_PATH_LEN	128
+
+// Upper bound on concurrently running tests when the CPU count is unknown
+#define MAX_JOBS	4
+
+// How long to sleep when polling finds no finished test (microseconds)
+#define REAP_WAIT	1000
+
+// Cycles each start of a test gets on the simulator when its optimized and
+// plain translations are compared; a start the plain one runs out on is
+// skipped, since the optimized one never needs more cycles
+#define OPT_CYCLES	1000
+
+// Results of comparing the optimized and plain translations of a test, any
+// other result is the first start that ended differently ($1 * 128 + $2)
+#define OPT_SAME	-1	// every start ended the same way
+#define OPT_ERRORS	-2	// only one of them translated without errors
+#define OPT_NO_LOAD	-3	// the simulator couldn't load the optimized one
 
-// The program we are testing
+// The program we are testing when running tests as separate processes
 #define	TRANS_EXEC	"./translator"
 
-short check_files(int test_num);
+// Flags
+#define EXEC_FLAG	"-e"	// run TRANS_EXEC per test instead of in-process
+#define JOBS_FLAG	"-j"	// followed by the number of tests to run at once
+
+/**
+ * A single discovered test and the state of its child process.
+ *
+ * name		The test's file name within TEST_IN (e.g. "test.3").
+ * num		The numeric suffix of the name, used for ordering.
+ * pid		The child running the test, or 0 if not running.
+ * status	The exit status reported by waitpid once reaped.
+ * skipped	Set if the test's files are missing and it was never run.
+ * res		The output of the test when translated in-process.
+ * opt_diff	How the test's translation with -O compared to res, OPT_SAME etc.
+ * img_diff	The output format whose image didn't hold the words of res, or
+ * 			OUT_TEXT if they all did.
+ */
+struct test{
+	char name[TEST_NAME_LEN];
+	long num;
+	pid_t pid;
+	int status;
+	short skipped;
+	struct translation res;
+	int opt_diff;
+	int img_diff;
+};
+
+/**
+ * test_pool
+ * Hands tests out to the threads of an in-process run.
+ *
+ * tests	Every test to run.
+ * count	The number of tests.
+ * next		The next test a thread should take.
+ * lock		Guards next.
+ */
+struct test_pool{
+	struct test *tests;
+	int count;
+	int next;
+	pthread_mutex_t lock;
+};
+
+int discover_tests(struct test **tests);
+short check_files(const char *name);
 void print_status(const char *color, const char *indent, FILE *out);
 void cleanup_older();
 short check_executable();
-void run_test(char *exec, int test_num);
-int compare_results(int test_num);
+short check_image_coding();
+pid_t run_test(char *exec, const char *name);
+void run_all_tests(char *exec, struct test *tests, int count, int jobs);
+void run_in_process(struct test *tests, int count, int jobs);
+void *test_worker(void *arg);
+int compare_results(struct test *t, short exec);
+int compare_optimized(const struct translation *plain, 
+		const struct translation *opt);
+int compare_images(const char *input, size_t size, const char *name,
+		const struct translation *text);
+int compare_output(const char *expected, struct source *actual, 
+		const char *what, short strip);
+void save_result(const char *path, const char *buf, size_t len);
+void strip_colors(char *line);
 void print_test_failed();
 void print_test_success();
 
 #endif
-
@@ -0,0 +1,96 @@
+/**
+ * File:		trace.c
+ * Author:		Grant Kurtz
+ *
+ * Description:	Trace output for finding out what the translator is doing,
+ * 				by category and level (see trace.h). Every trace line goes
+ * 				to stderr as "trace <category> <file>:<line>: <message>".
+ * 				Tracing is set up once, before any translation starts, so
+ * 				the levels are shared by every worker of a batch.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "symbols.h"
+#include "trace.h"
+
+// The level each category is traced at, all off to begin with
+unsigned char trace_levels[TRACE_CATS];
+
+// The name of each category, indexed by TRACE_*
+static const char *const trace_names[TRACE_CATS] = {
+	[TRACE_READ]	= "read",
+	[TRACE_PARSE]	= "parse",
+	[TRACE_SYMBOL]	= "symbol",
+	[TRACE_RESOLVE]	= "resolve",
+	[TRACE_WRITE]	= "write",
+};
+
+/**
+ * Turns tracing on for the categories named in a spec, such as
+ * "parse=2,resolve" or "all=1". Categories the spec doesn't name are left as
+ * they are, so a spec given on the command line adds to the environment's.
+ *
+ * @param	spec	The spec, see trace.h; 0 changes nothing.
+ * @return			0 on success, -1 if some part of the spec was not
+ * 					understood (the parts before it are still used).
+ */
+int trace_setup(const char *spec){
+	const char *end;
+	size_t len;
+	int cat, level;
+	while(spec && *spec){
+		end = spec + strcspn(spec, "=,");
+		len = end - spec;
+		level = TRACE_MAX;
+		if(*end == '='){
+			level = 0;
+			for(end++; *end >= '0' && *end <= '9'; end++)
+				level = level * 10 + (*end - '0');
+			if(level > TRACE_MAX)
+				level = TRACE_MAX;
+			if(*end && *end != ',')
+				return -1;
+		}
+
+		// every category, or just the one named
+		if(len == 3 && !strncmp(spec, "all", 3)){
+			for(cat = 0; cat < TRACE_CATS; cat++)
+				trace_levels[cat] = level;
+		}
+		else{
+			for(cat = 0; cat < TRACE_CATS; cat++){
+				if(strlen(trace_names[cat]) == len &&
+						!strncmp(spec, trace_names[cat], len))
+					break;
+			}
+			if(cat == TRACE_CATS)
+				return -1;
+			trace_levels[cat] = level;
+		}
+		spec = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
+/**
+ * Writes one trace line to stderr, in a single write so that the lines of
+ * several workers don't get mixed up. Use TRACE() rather than calling this
+ * directly, so that nothing is formatted unless the trace is on.
+ *
+ * @param	prog	The program being translated, or 0 if there is none.
+ * @param	cat		The category of the trace (TRACE_*).
+ * @param	fmt		printf() style format of the message.
+ */
+void trace_print(const struct program *prog, int cat, const char *fmt, ...){
+	char msg[TRACE_LINE_MAX];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+	fprintf(stderr, "trace %s %s:%u: %s\n", trace_names[cat], 
+			prog && prog->input ? prog->input : "-", 
+			prog ? prog->line_count : 0, msg);
+}
@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Trace Categories
+#define TRACE_READ		0	// lines and tokens as they are read
+#define TRACE_PARSE		1	// instructions and their operands
+#define TRACE_SYMBOL	2	// labels, functions and constants
+#define TRACE_RESOLVE	3	// translating what names a symbol
+#define TRACE_WRITE		4	// the words written out
+#define TRACE_CATS		5
+
+// Trace Levels
+// A category traced at some level also shows everything of lower levels
+#define TRACE_OFF		0
+#define TRACE_PHASE		1	// a few lines per translation
+#define TRACE_LINE		2	// about a line per source line
+#define TRACE_TERM		3	// a line per token or term
+#define TRACE_MAX		TRACE_TERM
+
+// Selecting Traces
+// A list of "<category>[=<level>]" separated by commas, "all" naming every
+// category; the level defaults to TRACE_MAX. Read from the environment, and
+// then from the -T flag
+#define TRACE_ENV		"HARTZ_TRACE"
+#define TRACE_LINE_MAX	256		// longest trace line, longer ones are cut
+
+// Building with NO_TRACE leaves every trace point out of the binary,
+// otherwise a trace point that is off costs one (rarely taken) branch
+#ifdef NO_TRACE
+	#define TRACE_ON(cat, lvl)	0
+#elif defined(__GNUC__)
+	#define TRACE_ON(cat, lvl)	__builtin_expect(trace_levels[cat] >= (lvl), 0)
+#else
+	#define TRACE_ON(cat, lvl)	(trace_levels[cat] >= (lvl))
+#endif
+
+// Writes a trace line for a program (may be 0), printf() style
+#define TRACE(prog, cat, lvl, ...) \
+	do{ \
+		if(TRACE_ON(cat, lvl)) \
+			trace_print(prog, cat, __VA_ARGS__); \
+	}while(0)
+
+struct program;
+
+extern unsigned char trace_levels[TRACE_CATS];
+
+// Setup
+int trace_setup(const char *spec);
+
+// Output
+void trace_print(const struct program *prog, int cat, const char *fmt, ...);
+
+#endif
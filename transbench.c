@@ -0,0 +1,374 @@
+/**
+* File: transbench.c
+* Author: Grant Kurtz
+*
+* Description: Measures how fast the translator runs. Synthetic Hartz programs
+* of 1K up to 1M lines are generated, and a translator (./translator, or the
+* one given with -x) is run on each of them as its own process with the -t
+* flag, so the lines translated per second, the peak memory use and the time
+* of every phase can be reported. "make bench" builds an optimized translator
+* as ./translator-bench and runs this on it. The generator can also be used
+* on its own (-g), to get a program of any size.
+*
+* The programs are always the same for a given number of lines, and the
+* report has one "key=value" line per size, so the output of two commits can
+* be compared line by line.
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "translator.h"
+#include "stats.h"
+
+// Benchmark Sizing
+#define BENCH_MIN_LINES	1000		// the first size, then ten times more
+#define BENCH_MAX_LINES	1000000		// until this many lines
+#define BENCH_TIME		0.5			// seconds to spend on each size
+#define BENCH_RUNS		20			// most runs of one size
+#define BENCH_SEED		12345		// of the generator, fixed for stable input
+#define BENCH_VERSION	1			// bumped if the report changes meaning
+
+// Generated Lines
+// What goes into a line of a generated unit, next to its format
+#define GEN_PLAIN		0	// nothing
+#define GEN_UNIT		1	// the number of the unit
+#define GEN_LIT			2	// a random literal
+#define GEN_CONST		3	// the number of the unit and a random value
+#define GEN_BEFORE		4	// the number of the unit before
+
+// Report Reading
+#define REPORT_KEYS		16			// most keys taken from a -t report
+#define REPORT_LINE		128
+
+// Temporary Files
+#define BENCH_IN		"/tmp/transbench.in.XXXXXX"
+#define BENCH_OUT		"/tmp/transbench.out.XXXXXX"
+#define BENCH_MSG		"/tmp/transbench.msg.XXXXXX"
+
+/**
+ * bench_run
+ * The outcome of translating one program once.
+ *
+ * double seconds			Wall time of the whole process
+ * long max_rss				Peak resident memory of the process, in KB
+ * int status				The exit status of the translator, or the status
+ * 							its report gives
+ * int key_count			The number of keys read from the -t report
+ * char keys[][]			The time.* and count.words lines of the report,
+ * 							as "key=value"
+ */
+struct bench_run{
+	double seconds;
+	long max_rss;
+	int status;
+	int key_count;
+	char keys[REPORT_KEYS][REPORT_LINE];
+};
+
+static void generate(FILE *out, long lines, unsigned long seed);
+static int bench_size(const char *trans, long lines, short optimize);
+static int run_translator(const char *trans, const char *in,
+		const char *out, const char *msg, short optimize,
+		struct bench_run *run);
+static void read_report(const char *msg, struct bench_run *run);
+static unsigned long next_rand(unsigned long *seed);
+static double now();
+
+int main(int argc, char **argv){
+	const char *trans = "./translator";
+	long max_lines = BENCH_MAX_LINES, gen_lines = 0, lines;
+	short optimize = 0;
+	int c, failed = 0;
+	for(c = 1; c < argc; c++){
+		if(!strcmp(argv[c], "-g") && c + 1 < argc)
+			gen_lines = atol(argv[++c]);
+		else if(!strcmp(argv[c], "-m") && c + 1 < argc)
+			max_lines = atol(argv[++c]);
+		else if(!strcmp(argv[c], "-x") && c + 1 < argc)
+			trans = argv[++c];
+		else if(!strcmp(argv[c], OPT_FLAG))
+			optimize = 1;
+		else{
+			fprintf(stderr, "usage: %s [-m <max-lines>] [-x <translator>] "
+					"[-O]\n"
+					"       %s -g <lines>\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+
+	// just a program, for trying things out by hand
+	if(gen_lines > 0){
+		generate(stdout, gen_lines, BENCH_SEED);
+		return 0;
+	}
+
+	printf("transbench.version %d\n", BENCH_VERSION);
+	printf("transbench.stats_version %d\n", STATS_VERSION);
+	printf("transbench.optimize %d\n", optimize);
+	fflush(stdout);
+	for(lines = BENCH_MIN_LINES; lines <= max_lines; lines *= 10)
+		failed |= bench_size(trans, lines, optimize);
+	return failed;
+}
+
+/**
+* Writes a Hartz program of exactly the given number of lines. It is made of
+* units that each use every opcode and operand format once: a constant, a
+* function called with STJ and left with LFSJ, and labels jumped to both
+* backwards and forwards (the latter waiting to be fixed up). The program
+* translates without errors, but isn't meant to be run.
+*
+* @param out 		Where to write the program.
+* @param lines 		The number of lines, at least one.
+* @param seed 		Picks the literals and constants, the same seed always
+* 					gives the same program.
+*/
+static void generate(FILE *out, long lines, unsigned long seed){
+	static const struct{
+		const char *fmt;
+		int kind;
+	} unit[] = {
+		{"* unit %ld",				GEN_UNIT},
+		{"#K%ld %d",				GEN_CONST},
+		{".F%ld",					GEN_UNIT},
+		{"L%ld:",					GEN_UNIT},
+		{"LW $d1",					GEN_PLAIN},
+		{"LW $d2",					GEN_PLAIN},
+		{"NOT $s1, $d1",			GEN_PLAIN},
+		{"SHL $s2, $d2",			GEN_PLAIN},
+		{"SHR $s1, $d1",			GEN_PLAIN},
+		{"OR $s1, $s2, $d1",		GEN_PLAIN},
+		{"AND $s1, $s2, $d2",		GEN_PLAIN},
+		{"ADD $s1, $s2, $d1",		GEN_PLAIN},
+		{"SW $s1",					GEN_PLAIN},
+		{"SI K%ld",					GEN_UNIT},
+		{"SI !%d",					GEN_LIT},
+		{"LI K%ld",					GEN_UNIT},
+		{"LI !%d",					GEN_LIT},
+		{"ROT $s2",					GEN_PLAIN},
+		{"ROT1",					GEN_PLAIN},
+		{"LROT K%ld",				GEN_UNIT},
+		{"LROT !%d",				GEN_LIT},
+		{"BEZ $s1, L%ld",			GEN_UNIT},
+		{"BEZ $s2, K%ld",			GEN_UNIT},
+		{"BEZ $s1, !%d",			GEN_LIT},
+		{"BEZ $s2, L%ld",			GEN_BEFORE},
+		{"STJ F%ld",				GEN_UNIT},
+		{"JMP M%ld",				GEN_UNIT},
+		{"JMP K%ld",				GEN_UNIT},
+		{"JMP !%d",					GEN_LIT},
+		{"NOP",						GEN_PLAIN},
+		{"F%ld:",					GEN_UNIT},
+		{"ADD $s1, $s2, $d2",		GEN_PLAIN},
+		{"LFSJ",					GEN_PLAIN},
+		{"M%ld:",					GEN_UNIT},
+		{"",						GEN_PLAIN},
+	};
+	const int unit_lines = sizeof(unit) / sizeof(unit[0]);
+	long n = 0, u = 0;
+	int i;
+
+	// the last line stops the program
+	lines--;
+	while(lines - n >= unit_lines){
+		for(i = 0; i < unit_lines; i++){
+			switch(unit[i].kind){
+				case GEN_PLAIN:
+					fputs(unit[i].fmt, out);
+					break;
+				case GEN_UNIT:
+					fprintf(out, unit[i].fmt, u);
+					break;
+				case GEN_LIT:
+					fprintf(out, unit[i].fmt, 
+							(int) (next_rand(&seed) % (MAX_INT + 1)));
+					break;
+				case GEN_CONST:
+					fprintf(out, unit[i].fmt, u, 
+							(int) (next_rand(&seed) % (MAX_INT + 1)));
+					break;
+				case GEN_BEFORE:
+					fprintf(out, unit[i].fmt, u ? u - 1 : u);
+					break;
+			}
+			fputc('\n', out);
+		}
+		n += unit_lines;
+		u++;
+	}
+
+	// whatever is left over is made up with comments
+	for(; n < lines; n++)
+		fprintf(out, "* filler\n");
+	fprintf(out, "HALT\n");
+}
+
+/**
+* Translates a program of one size as many times as fits in BENCH_TIME, and
+* prints the fastest run, along with the highest peak memory use of all runs.
+*
+* @param trans 		The translator to run.
+* @param lines 		The size of the program.
+* @param optimize 	1 to translate with -O.
+* @return 			0 on success, 1 if the program couldn't be set up or
+* 					didn't translate.
+*/
+static int bench_size(const char *trans, long lines, short optimize){
+	char in[] = BENCH_IN, out[] = BENCH_OUT, msg[] = BENCH_MSG;
+	int fd_in = mkstemp(in), fd_out = mkstemp(out), fd_msg = mkstemp(msg);
+	struct bench_run run, best;
+	FILE *f = fd_in == -1 ? 0 : fdopen(fd_in, "w");
+	int runs = 0, i, ret = 1;
+	long max_rss = 0;
+	double spent = 0;
+	if(fd_out != -1)
+		close(fd_out);
+	if(fd_msg != -1)
+		close(fd_msg);
+	if(!f || fd_out == -1 || fd_msg == -1){
+		fprintf(stderr, "Unable to create temporary files!\n");
+		if(f)
+			fclose(f);
+		else if(fd_in != -1)
+			close(fd_in);
+		goto done;
+	}
+	generate(f, lines, BENCH_SEED);
+	if(fclose(f)){
+		fprintf(stderr, "Unable to write '%s'!\n", in);
+		goto done;
+	}
+
+	memset(&best, 0, sizeof(struct bench_run));
+	while(runs < BENCH_RUNS && (!runs || spent < BENCH_TIME)){
+		if(run_translator(trans, in, out, msg, optimize, &run))
+			goto done;
+		if(run.status){
+			fprintf(stderr, "%s failed on %ld lines (%d)!\n", trans, lines,
+					run.status);
+			goto done;
+		}
+		if(!runs || run.seconds < best.seconds)
+			best = run;
+		if(run.max_rss > max_rss)
+			max_rss = run.max_rss;
+		spent += run.seconds;
+		runs++;
+	}
+
+	printf("lines=%ld runs=%d seconds=%.6f lines_per_sec=%.0f "
+			"max_rss_kb=%ld", lines, runs, best.seconds,
+			best.seconds > 0 ? lines / best.seconds : 0, max_rss);
+	for(i = 0; i < best.key_count; i++)
+		printf(" %s", best.keys[i]);
+	printf("\n");
+	fflush(stdout);
+	ret = 0;
+
+done:
+	remove(in);
+	remove(out);
+	remove(msg);
+	return ret;
+}
+
+/**
+* Runs the translator once, as its own process, with its report going to a
+* file.
+*
+* @param trans 		The translator to run.
+* @param in 		The program to translate.
+* @param out 		Where the image goes.
+* @param msg 		Where stdout (and with it the -t report) goes.
+* @param optimize 	1 to translate with -O.
+* @param run 		Filled in with the outcome.
+* @return 			0 on success, -1 if the translator couldn't be started.
+*/
+static int run_translator(const char *trans, const char *in,
+		const char *out, const char *msg, short optimize,
+		struct bench_run *run){
+	struct rusage usage;
+	int status, fd;
+	memset(run, 0, sizeof(struct bench_run));
+	double start = now();
+	pid_t pid = fork();
+	if(pid == -1){
+		fprintf(stderr, "Unable to start '%s'!\n", trans);
+		return -1;
+	}
+	if(!pid){
+		if((fd = open(msg, O_WRONLY | O_TRUNC)) == -1 ||
+				dup2(fd, STDOUT_FILENO) == -1)
+			_exit(127);
+		close(fd);
+		if(optimize)
+			execl(trans, trans, in, out, TIME_FLAG, OPT_FLAG, (char *) 0);
+		else
+			execl(trans, trans, in, out, TIME_FLAG, (char *) 0);
+		_exit(127);
+	}
+	if(wait4(pid, &status, 0, &usage) == -1){
+		fprintf(stderr, "Lost track of '%s'!\n", trans);
+		return -1;
+	}
+	run->seconds = now() - start;
+	run->max_rss = usage.ru_maxrss;
+	run->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	if(run->status == 127){
+		fprintf(stderr, "Unable to run '%s'!\n", trans);
+		return -1;
+	}
+
+	// the translator exits with 0 on some errors, its report knows better
+	read_report(msg, run);
+	return 0;
+}
+
+/**
+* Takes the status, the times and the number of words out of the -t report
+* of a run, the latter two in the order the report gives them.
+*/
+static void read_report(const char *msg, struct bench_run *run){
+	char line[REPORT_LINE];
+	char *val;
+	FILE *f = fopen(msg, "r");
+	if(!f)
+		return;
+	while(fgets(line, sizeof(line), f) && run->key_count < REPORT_KEYS){
+		if(!strncmp(line, "stats.status ", 13))
+			run->status = atoi(line + 13);
+		if(strncmp(line, "time.", 5) && strncmp(line, "count.words ", 12))
+			continue;
+		if(!(val = strchr(line, ' ')))
+			continue;
+		*val = '=';
+		line[strcspn(line, "\n")] = '\0';
+		strcpy(run->keys[run->key_count++], line);
+	}
+	fclose(f);
+}
+
+/**
+* A small linear congruential generator, so the programs don't depend on the
+* rand() of the C library.
+*/
+static unsigned long next_rand(unsigned long *seed){
+	*seed = (*seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return *seed >> 16;
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -5,131 +5,348 @@
 * Description: Turns Hartz assembly code into a "binary executable".
 */
  
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 #include "translator.h"
 #include "symbols.h"
 #include "idents.h"
 #include "strlib.h"
 #include "generrors.h"
 #include "terms.h"
+#include "arena.h"
+#include "opcodes.h"
+#include "image.h"
+#include "peephole.h"
+#include "fixups.h"
+#include "stats.h"
+#include "trace.h"
 
-// Argument data
-int warnings = 0;
-int print_tables = 0;
-int print_comp_i = 0;
-int make_fast = 0;
-
-int main(int argc, char **argv){
-
-	// perform sanity check on arguments
-	if(argc < 3 || argc > 6){
-		print_help(argv[0]);
-		return 1;
-	}
-
-	// process argument options
-	int c = 3;
-	while(c < argc){
-		if(strcmp(argv[c], WARN_FLAG) == 0)
-			warnings = 1;
-		else if(strcmp(argv[c], SYST_FLAG) == 0)
-			print_tables = 1;
-		else if(strcmp(argv[c], COMP_INFO) == 0)
-			print_comp_i = 1;
-		else if(strcmp(argv[c], HELP_FLAG) == 0)
-			print_help(argv[0]);
-		else if(strcmp(argv[c], FAST_FLAG) == 0)
-			make_fast = 1;
-		else{
-			print_asterisk(RED_C, stderr);
-			fprintf(stderr, "Unknown flag '%s'.\n\n", argv[c]);
-			print_help(argv[0]);
-			return 1;
-		}
-		c++;
-	}
+/**
+ * batch_job
+ * char *input			The file to translate
+ * char *output			The file to write the image to
+ * int status			The result of translate_file()
+ */
+struct batch_job{
+	char *input;
+	char *output;
+	int status;
+};
+
+/**
+ * batch
+ * struct batch_job *jobs	Every translation listed in the manifest
+ * int count				The number of jobs
+ * int size					The allocated size of jobs
+ * int next					The next job a worker should take
+ * pthread_mutex_t lock		Guards next
+ * struct options opts		The options every job runs with
+ */
+struct batch{
+	struct batch_job *jobs;
+	int count;
+	int size;
+	int next;
+	pthread_mutex_t lock;
+	struct options opts;
+};
+
+/**
+* Translates one input file into one output file. Everything the translation
+* needs lives in this call, so any number of them may run at once.
+*
+* @param input 		The Hartz assembly file to read.
+* @param output 	The file to write the program image to.
+* @param opts 		The options chosen on the command line.
+* @return 			0 on success, 2 if the files could not be opened, otherwise
+* 					the error code of the translation.
+*/
+int translate_file(const char *input, const char *output, 
+		const struct options *opts){
 
 	// try to open/create the files the user wants us to use
-	FILE *input_file = fopen(argv[1], "r");
+	FILE *input_file = fopen(input, "r");
 	FILE *out_file = 0;
+	char *tmp_name = 0;
 
 	if(!input_file){
 		print_asterisk(RED_C, stderr);
 		fprintf(stderr, "Error: Unable to open '%s' for "
-		"reading, exiting.\n", argv[1]);
+		"reading, exiting.\n", input);
 		return 2;
 	}
-	out_file = open_write_file(argv[2]);
+	out_file = opts->atomic_out ? open_temp_file(output, &tmp_name) 
+			: open_write_file(output);
 	if(!out_file){
 		print_asterisk(RED_C, stderr);
 		fprintf(stderr, "Error: Unable to open '%s' for writing, exiting.\n",
-				argv[2]);
+				output);
+		fclose(input_file);
 		return 2;
 	}
 
-	// print banner
-	if(print_comp_i){
-		printf( "\t\t=== Hartz Translator ===\n"
-				"Machine Constraints\n"
-				"\t%d Bytes of Memory\n"
-				"\t%d Registers\n"
-				"\t%d Bytes of Cache\n\n"
-				"Compiler Constraints\n"
-				"\tMax Line Length of %d Bytes\n"
-				"\tMax One Instruction Per Line\n\n",
-				MAX_MEMORY, MAX_REGS, MAX_CACHE, MAX_LINE_LEN);
+	// setup our program struct to store some data
+	struct program program;
+	struct symbol_table tbl;
+	struct symbol_table const_tbl;
+	memset(&program, 0, sizeof(struct program));
+	memset(&tbl, 0, sizeof(struct symbol_table));
+	memset(&const_tbl, 0, sizeof(struct symbol_table));
+	program.opts = *opts;
+	program.out = out_file;
+	program.msg = stdout;
+	program.err = stderr;
+	program.input = (char *) input;
+	program.in = input_file;
+	program.tbl = &tbl;
+	program.const_tbl = &const_tbl;
+
+	run_translation(&program);
+	fclose(input_file);
+
+	// a failed translation never replaces the output when writing atomically
+	if(close_write_file(out_file, output, tmp_name, !program.error_code)
+			&& !program.error_code){
+		print_asterisk(RED_C, stderr);
+		fprintf(stderr, "Error: Unable to finish writing '%s'.\n", output);
+		program.error_code = FAULT;
 	}
+	print_result(&program);
+	return program.error_code;
+}
 
-	// setup our program struct to store some data
-	struct program *program = (struct program*) malloc(sizeof(struct program));
-	memset(program, 0, sizeof(struct program));
-	program->out = out_file;
-	program->input = argv[1];
-	program->in = input_file;
-
-	if(make_fast){
-		write_instruc_str(HALT, 0, 0, 0, 0, program);
-		fclose(input_file);
-		fclose(out_file);
-		return 0;
+/**
+* Translates a program held in memory, without touching any files. The image
+* and everything the translation prints are collected into buffers in res,
+* which must be released with free_translation().
+*
+* @param input 		The Hartz assembly source.
+* @param size 		The number of bytes in input.
+* @param name 		The name to report errors against.
+* @param opts 		The options to translate with.
+* @param res 		Filled in with the image, messages and error code.
+* @return 			The error code of the translation, or ALLOC_ERR if the
+* 					result buffers could not be created.
+*/
+int translate_memory(const char *input, size_t size, const char *name,
+		const struct options *opts, struct translation *res){
+	memset(res, 0, sizeof(struct translation));
+	FILE *out = open_memstream(&res->out, &res->out_len);
+	FILE *msg = open_memstream(&res->msg, &res->msg_len);
+	FILE *err = open_memstream(&res->err, &res->err_len);
+	if(!out || !msg || !err){
+		if(out)
+			fclose(out);
+		if(msg)
+			fclose(msg);
+		if(err)
+			fclose(err);
+		free_translation(res);
+		return res->error_code = ALLOC_ERR;
 	}
 
-	// create the symbol table
-	struct symbol_table *tbl = (struct symbol_table*) malloc(
-	sizeof(struct symbol_table));
-	memset(tbl, 0, sizeof(struct symbol_table));
-	program->tbl = tbl;
+	struct program program;
+	struct symbol_table tbl;
+	struct symbol_table const_tbl;
+	memset(&program, 0, sizeof(struct program));
+	memset(&tbl, 0, sizeof(struct symbol_table));
+	memset(&const_tbl, 0, sizeof(struct symbol_table));
+	program.opts = *opts;
+	program.out = out;
+	program.msg = msg;
+	program.err = err;
+	program.input = (char *) name;
+	program.tbl = &tbl;
+	program.const_tbl = &const_tbl;
+	open_source_buffer(&program.src, input, size);
+
+	run_translation(&program);
+	print_result(&program);
+	fclose(out);
+	fclose(msg);
+	fclose(err);
+	return res->error_code = program.error_code;
+}
 
-	// Create the table for constants
-	struct symbol_table *const_tbl = (struct symbol_table*) malloc(
-	sizeof(struct symbol_table));
-	memset(const_tbl, 0, sizeof(struct symbol_table));
-	program->const_tbl = const_tbl;
+/**
+* Releases the buffers of a translation made by translate_memory().
+*/
+void free_translation(struct translation *res){
+	free(res->out);
+	free(res->msg);
+	free(res->err);
+	res->out = res->msg = res->err = 0;
+	res->out_len = res->msg_len = res->err_len = 0;
+}
 
-	// start processing file
-	process_input_program(program);
-	fclose(input_file);
-	fclose(out_file);
+/**
+* Produces the program image for an already set up program, either the
+* shortcut image of the fast option or a full translation of its input.
+*/
+void run_translation(struct program *program){
+	double start = stats_clock();
+	if(program->opts.make_fast){
+		unsigned char halt = HALT;
+		emit_words(&halt, 1, program);
+	}
+	else{
+		// start processing file
+		process_input_program(program);
+	}
+	program->stats.total = stats_clock() - start;
+}
 
-	if(print_tables){
-		printf("\n");
-		print_symbols(program->tbl);
-		print_symbols(program->const_tbl);
-		printf("\n");
+/**
+* Tells the user how the translation ended, unless running quietly, and
+* prints the -t report if asked for (even when quiet).
+*/
+void print_result(struct program *program){
+	if(!program->opts.quiet && program->error_code){
+		print_asterisk(RED_C, program->err);
+		fprintf(program->err, "Stopped processing because of an error.\n");
 	}
+	else if(!program->opts.quiet){
+		print_asterisk(GRN_C, program->msg);
+		fprintf(program->msg, "Done!\n");
+	}
+	if(program->opts.timings)
+		print_stats(program);
+}
 
-	if(program->error_code){
+/**
+* Reads a manifest of "<input-file> <output-file>" lines and translates all
+* of them on a pool of worker threads, then prints the outcome of each.
+* Blank lines and lines starting with a comment symbol are skipped.
+*
+* @param manifest 	The manifest file, or "-" for stdin.
+* @param workers 	The number of worker threads, 0 picks one per CPU.
+* @param opts 		The options every translation is run with.
+* @return 			0 if every file translated, 1 if any failed, 2 if the
+* 					manifest could not be read.
+*/
+int translate_batch(const char *manifest, int workers, 
+		const struct options *opts){
+	FILE *in = strcmp(manifest, "-") ? fopen(manifest, "r") : stdin;
+	struct source src;
+	if(!in || open_source(&src, in)){
 		print_asterisk(RED_C, stderr);
-		fprintf(stderr, "Stopped processing because of an error.\n");
+		fprintf(stderr, "Error: Unable to read manifest '%s'.\n", manifest);
+		if(in && in != stdin)
+			fclose(in);
+		return 2;
 	}
-	else{
-		print_asterisk(GRN_C, stdout);
-		printf("Done!\n");
+	if(in != stdin)
+		fclose(in);
+
+	// collect the jobs
+	struct batch batch;
+	int c;
+	memset(&batch, 0, sizeof(struct batch));
+	batch.opts = *opts;
+	batch.opts.quiet = 1;
+	char *tok, *out;
+	unsigned int line = 0;
+	while(next_line(&src)){
+		line++;
+		const char *s;
+		size_t len = trimmed_line(&src, &s);
+		if(!len || *s == COMMENT_SYM)
+			continue;
+		char *copy = (char *) malloc(len + 1);
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+		char *save;
+		if(!(tok = strtok_r(copy, STR_TOK_SEP, &save)) || 
+				!(out = strtok_r(0, STR_TOK_SEP, &save)) ||
+				strtok_r(0, STR_TOK_SEP, &save)){
+			print_asterisk(RED_C, stderr);
+			fprintf(stderr, "%s, %u:\n", manifest, line);
+			print_asterisk(RED_C, stderr);
+			fprintf(stderr, "\tExpected '<input-file> <output-file>'.\n");
+			free(copy);
+			continue;
+		}
+		if(batch.count == batch.size){
+			batch.size = batch.size ? batch.size * 2 : 16;
+			batch.jobs = (struct batch_job *) realloc(batch.jobs, 
+					batch.size * sizeof(struct batch_job));
+		}
+		batch.jobs[batch.count].input = tok;
+		batch.jobs[batch.count].output = out;
+		batch.jobs[batch.count].status = 0;
+		batch.count++;
+	}
+	close_source(&src);
+
+	// run the pool
+	if(workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(workers <= 0)
+		workers = 1;
+	if(workers > batch.count)
+		workers = batch.count ? batch.count : 1;
+	pthread_t *threads = (pthread_t *) malloc(workers * sizeof(pthread_t));
+	pthread_mutex_init(&batch.lock, 0);
+	int started = 0;
+	while(started < workers){
+		if(pthread_create(&threads[started], 0, batch_worker, &batch))
+			break;
+		started++;
+	}
+	if(!started)
+		batch_worker(&batch);
+	for(c = 0; c < started; c++)
+		pthread_join(threads[c], 0);
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+
+	// summary
+	int failed = 0;
+	printf("\n\t\t===== Batch Summary =====\n");
+	for(c = 0; c < batch.count; c++){
+		struct batch_job *job = &batch.jobs[c];
+		if(job->status){
+			failed++;
+			print_asterisk(RED_C, stdout);
+			printf("%s -> %s: failed (%d)\n", job->input, job->output, 
+					job->status);
+		}
+		else{
+			print_asterisk(GRN_C, stdout);
+			printf("%s -> %s: done\n", job->input, job->output);
+		}
+		free(job->input); // the start of the manifest line copy
 	}
+	print_asterisk(failed ? RED_C : GRN_C, stdout);
+	printf("%d of %d files failed.\n", failed, batch.count);
+	free(batch.jobs);
+	return failed ? 1 : 0;
+}
+
+/**
+* Worker thread body, takes jobs off the batch until none are left.
+*/
+void *batch_worker(void *arg){
+	struct batch *batch = (struct batch *) arg;
+	int i;
+	while(1){
+		pthread_mutex_lock(&batch->lock);
+		i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if(i >= batch->count)
+			break;
+		batch->jobs[i].status = translate_file(batch->jobs[i].input, 
+				batch->jobs[i].output, &batch->opts);
+	}
+	return 0;
 }
 
 /**
@@ -144,31 +361,120 @@ FILE *open_write_file(const char *file){
 	return out_file;
 }
 
+// Counts the temporary files opened by this process, so that batch workers
+// never try the same name
+static pthread_mutex_t temp_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long temp_count = 0;
+
+/**
+* Opens a temporary file next to the given file, so that it can later be
+* renamed over it in one step by close_write_file(). The file is created
+* with the same mode fopen() uses, so the kernel applies the umask to it just
+* as it would have to the real one.
+*
+* @param file 		The file that will eventually be written.
+* @param tmp_name 	Set to the (malloc'd) name of the temporary file.
+* @return 			The opened temporary file, otherwise 0.
+*/
+FILE *open_temp_file(const char *file, char **tmp_name){
+	size_t size = strlen(file) + TEMP_EXTRA;
+	char *name = (char *) malloc(size);
+	if(!name)
+		return 0;
+	int fd = -1;
+	unsigned long n;
+	for(int i = 0; fd == -1 && i < TEMP_TRIES; i++){
+		pthread_mutex_lock(&temp_lock);
+		n = temp_count++;
+		pthread_mutex_unlock(&temp_lock);
+
+		// a name can only be taken by a file left behind by another run
+		snprintf(name, size, TEMP_NAME, file, (long) getpid(), n);
+		fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if(fd == -1 && errno != EEXIST)
+			break;
+	}
+	if(fd == -1){
+		free(name);
+		return 0;
+	}
+	FILE *out_file = fdopen(fd, "w");
+	if(!out_file){
+		close(fd);
+		remove(name);
+		free(name);
+		return 0;
+	}
+	*tmp_name = name;
+	return out_file;
+}
+
+/**
+* Closes a file opened by open_write_file() or open_temp_file(). A temporary
+* file is renamed over the real one if keep is set, otherwise it is removed.
+*
+* @param out 		The file to close.
+* @param file 		The name of the real file.
+* @param tmp_name 	The name of the temporary file, or 0 if out is the real
+* 					file. It is freed.
+* @param keep 		1 if the output should be kept.
+* @return 			0 on success, otherwise -1 if writing failed.
+*/
+int close_write_file(FILE *out, const char *file, char *tmp_name, 
+		short keep){
+	int ret = fclose(out) ? -1 : 0;
+	if(tmp_name){
+		if(keep && !ret)
+			ret = rename(tmp_name, file) ? -1 : 0;
+		else
+			remove(tmp_name);
+		free(tmp_name);
+	}
+	return ret;
+}
+
 
 /**
 * Given a program struct, will process the (already opened) input file and
-* begin compilation line by line.
+* begin compilation line by line. Without an input file, the source must
+* already have been set up with open_source_buffer(). Every symbol and encoded string made
+* along the way lives in an arena that is released before returning, so the
+* symbol tables and the term table are emptied again once this is done.
 */
 void process_input_program(struct program *program){
 
-	print_asterisk(GRN_C, stdout);
-	printf("Processing File...\n");
+	if(!program->opts.quiet){
+		print_asterisk(GRN_C, program->msg);
+		fprintf(program->msg, "Processing File...\n");
+	}
 	char *tok;
-	char buf[MAX_LINE_LEN+1];
-	buf[MAX_LINE_LEN] = 0;
+	double lap = stats_clock();
+
+	// map the input so lines can be read straight out of memory
+	if(program->in && open_source(&program->src, program->in)){
+		report_at(program, DIAG_ERROR, FAULT, NO_LINE, 
+				"Error: Unable to read '%s'.", program->input);
+		return;
+	}
+	lap = stats_lap(program, PHASE_READ, lap);
+
+	// everything allocated for this translation comes from here
+	program->mem = arena_create(ARENA_CHUNK);
+	if(!program->mem){
+		close_source(&program->src);
+		print_memory_error(program);
+		return;
+	}
+	program->tbl->mem = program->mem;
+	program->const_tbl->mem = program->mem;
+	program->fix.pending.mem = program->mem;
 
 	// parse input file
-	do{
+	while(!program->error_code && next_line(&program->src)){
 		program->line_count++;
-		#ifdef DEBUG
-		fprintf(stderr, "*** Reading Line %d...\n", program->line_count);
-		#endif
-		fgetpos(program->in, &program->str_line);
-		tok = read_next_token(buf, program->in, MAX_LINE_LEN);
-
-		#ifdef DEBUG
-			fprintf(stderr, "Read Token '%s'\n", tok);
-		#endif
+		tok = first_token(&program->src);
+		TRACE(program, TRACE_READ, TRACE_LINE, "first token '%s'",
+				tok ? tok : "");
 
 		if(!tok){
 			continue; // just a whitespace line, move on
@@ -181,36 +487,81 @@ void process_input_program(struct program *program){
 		// check if there is garbage at the end of the line
 		if(!program->error_code)
 			check_garbage(program);
-	}while(!check_EOF(program->in) && !program->error_code);
+	}
+	stats_lap(program, PHASE_PARSE, lap);
+	program->stats.terms = program->terms.count;
 
-	if(program->error_code)
-		return;
+	if(!program->error_code)
+		translate_program(program);
+
+	if(program->opts.print_tables){
+		fprintf(program->msg, "\n");
+		print_symbols(program->tbl, program->msg);
+		print_symbols(program->const_tbl, program->msg);
+		fprintf(program->msg, "\n");
+	}
+
+	// release everything the translation allocated in one go
+	collect_stats(program);
+	close_source(&program->src);
+	arena_release(program->mem);
+	program->mem = 0;
+	memset(program->tbl, 0, sizeof(struct symbol_table));
+	memset(program->const_tbl, 0, sizeof(struct symbol_table));
+	memset(&program->pos_idx, 0, sizeof(struct symbol_index));
+	memset(&program->fix, 0, sizeof(struct fixup_list));
+	free_term_table(&program->terms);
+}
+
+/**
+* Runs the passes that follow parsing: symbol resolution (either what the one
+* pass translation left waiting, or all of it after the optional peephole
+* pass), writing the output file and reporting warnings.
+*/
+void translate_program(struct program *program){
+	int saved;
+	double lap = stats_clock();
 
-	// resolve constants/labels
-	#ifdef DEBUG
-		fprintf(stderr, "LAST TERM: '%s' TRANS: %d\n", 
-				program->end_term->term, program->end_term->trans);
-	#endif
-	translate_terms(program->terms, program);
+	// operands were translated while parsing, see fixups.c
+	if(!program->opts.optimize){
+		close_fixups(program);
+	}
+	else{
+		// rewrite instruction sequences while labels can still move
+		if((saved = optimize_terms(program)) && !program->opts.quiet){
+			print_asterisk(GRN_C, program->msg);
+			fprintf(program->msg, "Peephole pass saved %d word%s.\n", saved,
+					saved == 1 ? "" : "s");
+		}
+		lap = stats_lap(program, PHASE_OPTIMIZE, lap);
+		if(program->error_code)
+			return;
+
+		// all labels/functions have their final positions now
+		build_pos_index(program->tbl, &program->pos_idx);
+
+		// resolve constants/labels
+		translate_terms(program);
+	}
+	lap = stats_lap(program, PHASE_RESOLVE, lap);
 
 	// write terms to out file
-	struct Term *t = program->terms;
-	write_terms(t, program);
+	write_terms(program);
+	lap = stats_lap(program, PHASE_WRITE, lap);
 
 	// process warnings
-	if(warnings){
+	if(program->opts.warnings){
 		check_warnings(program);
+		stats_lap(program, PHASE_WARN, lap);
 	}
 
-	#ifdef DEBUG
-		// why did we quit?
-		if(program->error_code){
-			fprintf(stderr, "Stopped processing because of an error.\n");
-		}
-		else if(check_EOF(program->in)){
-			fprintf(stderr, "Stopped processing because EOF reached.\n");
-		}
-	#endif
+	// why did we quit?
+	if(program->error_code)
+		TRACE(program, TRACE_PARSE, TRACE_PHASE, "stopped by error %d",
+				program->error_code);
+	else
+		TRACE(program, TRACE_PARSE, TRACE_PHASE, "translated %d words",
+				program->terms.count);
 }
 
 /**
@@ -224,6 +575,8 @@ void process_input_program(struct program *program){
 */
 void process_token(char *tok, struct program *program){
 
+	const struct opcode *op;
+
 	// check for comments
 	if(check_comment(tok, program)){
 		process_comment(program);
@@ -249,537 +602,340 @@ void process_token(char *tok, struct program *program){
 	}
 
 	// the first token should contain our instruction
-	else if(!strcmp(tok, "HALT")){
-		process_instruction(program, HALT, HALT_F , 0);
-	}
-	else if(!strcmp(tok, "NOT")){
-		process_instruction(program, NOT, NOT_F, 0);
-	}
-	else if(!strcmp(tok, "SHL")){
-		process_instruction(program, SHL, SHL_F, 0);
-	}
-	else if(!strcmp(tok, "SHR")){
-		process_instruction(program, SHR, SHR_F, 0);
-	}
-	else if(!strcmp(tok, "OR")){
-		process_instruction(program, OR, OR_F, 0);
-	}
-	else if(!strcmp(tok, "AND")){
-		process_instruction(program, AND, AND_F, 0);
-	}
-	else if(!strcmp(tok, "ADD")){
-		process_instruction(program, ADD, ADD_F, 0);
-	}
-	else if(!strcmp(tok, "SW")){
-		process_instruction(program, SW, SW_F, 0);
-	}
-	else if(!strcmp(tok, "SI")){
-		process_instruction(program, SI, SI_F, 0);
-	}
-	else if(!strcmp(tok, "LW")){
-		process_instruction(program, LW, LW_F, 0);
-	}
-	else if(!strcmp(tok, "LI")){
-		process_instruction(program, LI, LI_F, 0);
-	}
-	else if(!strcmp(tok, "BEZ")){
-		process_instruction(program, BEZ, BEZ_F, 0);
-	}
-	else if(!strcmp(tok, "ROT")){
-		process_instruction(program, ROT, ROT_F, 0);
-	}
-	else if(!strcmp(tok, "ROT1")){
-		process_instruction(program, ROT1, ROT1_F, 0);
-	}
-	else if(!strcmp(tok, "JMP")){
-		process_instruction(program, JMP, JMP_F, 0);
-	}
-	else if(!strcmp(tok, "NOP")){
-		process_instruction(program, NOP, NOP_F, 0);
-	}
-	else if(!strcmp(tok, "LFSJ")){
-		process_instruction(program, LFSJ, LFSJ_F, 0);
-	}
-	else if(!strcmp(tok, "STJ")){
-		process_instruction(program, STJ, STJ_F, 0);
+	else if( (op = find_opcode(tok)) ){
+		process_instruction(program, op);
 	}
 
 	// looks like a bad opcode
 	else{
-		#ifdef DEBUG
-			fprintf(stderr, "BAD CODE '%s'\n", tok);
-		#endif
+		TRACE(program, TRACE_PARSE, TRACE_LINE, "bad opcode '%s'", tok);
 		print_unexpected_ident(tok, program);
 	}
 }
 
+// Operand parsers, indexed by operand class
+static short (*const parse_operand[OPND_CLASSES])(char *tok, int t,
+		struct program *prog, short quiet) = {
+	[OPND_SRC]		= parse_src_operand,
+	[OPND_DST]		= parse_dst_operand,
+	[OPND_LABEL]	= parse_label_operand,
+	[OPND_CONST]	= parse_const_operand,
+	[OPND_LIT]		= parse_lit_operand,
+	[OPND_TERM]		= parse_term_operand,
+};
+
 /**
-* Will attempt to parse the rest of the input line according to the
-* restrictions given by the format string. The format string is used to
-* specify, in the given order, how to parse the next token. The following
-* format is accepted (strictly):
-*
-* 	s -> Source register
-* 	d -> Destination register
-* 	l -> Label
-* 	c -> Constant
-* 	n -> Literal number
-* 	t -> Place an empty term after this term
-* 	[ -> Start 'or' expression (non-recursive)
-* 	] -> End 'or' expression
-*
-* Note that the or expression works as expected, so "[lcn]" translates to
-* "take whichever successfully parses first, either a label, constant, or
-* a number".
+* Will attempt to parse the rest of the input line according to the compiled
+* operand format (see compile_format()). Each operand takes the next token
+* and hands it to the parser for its class; an operand with several
+* alternatives offers the same token to each of them until one accepts it.
 *
-* If the or condition fails, or any parsing fails, an error is printed
+* If all alternatives fail, or any parsing fails, an error is printed
 * and all processing stops (the function does however return instead of
 * calling exit()).
 *
 * @param prog 		Contains general program information thus far gathered,
 * 					and is used for handling error reporting.
-* @param opcode 	The binary operation that this line started with.
-* @param fmt 		The format string for what arguments to expect.
-* @param misc 		Any bits that need to be added as the last child to the
-* 					opcode term.
+* @param op 		The instruction that this line started with.
 */
-void process_instruction(struct program *prog, char *opcode, const char *fmt,
-		char *misc){
+void process_instruction(struct program *prog, const struct opcode *op){
 
-	// create a term for this instruction
-	struct Term *t = create_term(opcode, strlen(opcode), 0);
+	// add a term for this instruction to our program, operand bits are added
+	// after the opcode
+	int t = add_term(&prog->terms, 0, TERM_DONE, prog->line_count, prog->mem);
 	if(!t){
-		#ifdef DEBUG
-			fprintf(stderr, "whoops! Looks like a nul-pointer...\n");
-		#endif
-		prog->error_code = -1;
+		print_memory_error(prog);
 		return;
 	}
-	t->trans = 1;
-	struct Term *child;
-	prog->term_count++;
-	t->pos = prog->term_count;
-
-	#ifdef DEBUG
-		fprintf(stderr, "OPCODE: '%s'\n", opcode);
-	#endif
-
-	// add term to our program
-	if(prog->terms){
-		prog->end_term->next_term = t;
-		prog->end_term = t;
-	}
-	else{
-		prog->terms = t;
-		prog->end_term = t;
-	}
-
-	if(!*opcode)
-		return;
-
+	prog->terms.ops[t] = op - opcodes;
+	prog->terms.bits = 0;
+	add_word_bits(&prog->terms, t, op->code >> (WORD_SIZE - op->len), op->len,
+			WORD_SIZE);
 
-	#ifdef DEBUG
-	fprintf(stderr, "FMT CODE: '%s'.\n", fmt);
-	#endif
+	TRACE(prog, TRACE_PARSE, TRACE_LINE, "%s at position %d", op->name, t);
 
 	// opcode argument parsing
-	short reg = -1;
-	char *iden = 0;
-	char *tok = 0;
-	int c = 0, or = 0, val = -1;
-	while(fmt[c]){
-		if(fmt[c] == 't'){
-			prog->end_term->next_term = create_term(0, 0, 0);
-			prog->end_term = prog->end_term->next_term;
-			prog->term_count++;
-			prog->end_term->pos = prog->term_count;
-			prog->end_term->absolute_pos = prog->line_count;
-		}
-		else if(or && ( (reg != -1) | (iden ? 1 : 0) | (val != -1) ) 
-				&&fmt[c] != ']'){
-			// do nothing...
-		}
-		else if(fmt[c] == '['){
-			or = 1;
-		}
-		else if(fmt[c] == ']'){
-			or = 0;
-
-			// if all options failed, report parse error
-			if(!reg && !iden && !val){
-				// TODO: create standardized error reporting....
-				print_compiler_error(prog, RED_C);
-				print_asterisk(RED_C, stderr);
-				fprintf(stderr, "\tUnexpected opcode argument.\n");
-				prog->error_code = GARBAGE;
-				return;
-			}
-
-			// reset everything
-			reg = -1;
-			iden = 0;
-			tok = 0;
-		}
-		else if(fmt[c] == 's'){
-			reg = read_src_reg(prog, or);
-			if(!or && reg == -1){
-				return;
-			}
+	const struct operand_fmt *fmt = opcode_format(op);
+	const struct operand *o;
+	char *tok;
+	int i, a;
+	for(i = 0; i < fmt->count; i++){
+		o = &fmt->ops[i];
+		tok = 0;
+		if(o->alts[0] != OPND_TERM && !(tok = next_token(&prog->src, ", \t"))){
+			report_error(prog, GARBAGE, "Missing opcode argument.");
+			return;
 		}
-		else if(fmt[c] == 'd'){
-			reg = read_dst_reg(prog, or);
-			if(!or && reg == -1){
+		for(a = 0; a < o->alt_count; a++){
+			if(parse_operand[o->alts[a]](tok, t, prog, o->alt_count > 1))
+				break;
+			if(prog->error_code)
 				return;
-			}
-		}
-		else if(fmt[c] == 'l'){
-			if(!tok && or){
-				tok = strtok(0, ", \t");
-				iden = tok;
-			}
-			else if(!or){
-				iden = strtok(0, ", \t");
-			}
-			else{
-				iden = tok;
-			}
-			
-			// create the term and add to the end
-			struct Term *nt = create_term(iden, strlen(iden), 0);
-			prog->term_count++;
-			nt->pos = prog->term_count;
-			prog->end_term->next_term = nt;
-			prog->end_term = nt;
-			nt->absolute_pos = prog->line_count;
-			#ifdef DEBUG
-			fprintf(stderr, "GOTS A LABEL!\n");
-			#endif
 		}
-		else if(fmt[c] == 'n'){
-			if(!tok && or){
-				tok = strtok(0, ", \t");
-				iden = tok;
-			}
-			else if(!or){
-				iden = strtok(0, ", \t");
-			}
-			else{
-				iden = tok;
-			}
-			if(!check_explicit_literal(iden, prog)){
-				if(!or){
-					print_expected_literal(iden, prog);
-					return;
-				}
-				iden = 0;
-			}
-			else{
-				val = process_literal(iden, MAX_INT);
-				iden = 0;
-				if(val < 0){
-					print_literal_too_large(iden, prog);
-					return;
-				}
-				else{
 
-					#ifdef DEBUG
-						fprintf(stderr, "GOTS A LITERAL!\n");
-					#endif
-
-					// create the term and add to the end
-					struct Term *nt = create_term(numtob(val, WORD_SIZE), 
-							strlen(iden), 0);
-					nt->trans = 1;
-					prog->term_count++;
-					nt->pos = prog->term_count;
-					prog->end_term->next_term = nt;
-					prog->end_term = nt;
-					nt->absolute_pos = prog->line_count;
-				}
+		// if all options failed, report parse error
+		if(a == o->alt_count){
+			if(o->alt_count > 1){
+				report_error(prog, GARBAGE, "Unexpected opcode argument.");
 			}
+			return;
 		}
-		else if(fmt[c] == 'c'){
-			if(!tok && or){
-				tok = strtok(0, ", \t");
-				iden = tok;
-			}
-			else if(!or){
-				iden = strtok(0, ", \t");
-			}
-			else{
-				iden = tok;
-			}
+	}
 
-			if(!check_const(iden, prog)){
-				if(!or){
-					print_expected_const(iden, prog);
-					return;
-				}
-				iden = 0;
-			}
-			else{
+	// translate the operands now if their symbols are known already
+	fix_operands(t, prog);
+}
 
-				#ifdef DEBUG
-					fprintf(stderr, "GOTS A CONSTANT!\n");
-				#endif
-
-				// create the term and add to the end
-				struct Term *nt = create_term(iden, strlen(iden), 0);
-				prog->term_count++;
-				nt->pos = prog->term_count;
-				prog->end_term->next_term = nt;
-				prog->end_term = nt;
-				nt->absolute_pos = prog->line_count;
-			}
-		}
-		else{
-			fprintf(stderr, " * Error In Compiler!!!\n\tStrange format code: "
-					"'%c'.\n", fmt[c]);
-		}
+/**
+* Adds a term for the next word on the text ring to the end of the program.
+*
+* @param str 		What the term names, may be 0 for an empty word that its
+* 					instruction fills in.
+* @param prog 		The program to add the term to.
+* @return 			The position of the new term, or 0 if memory ran out.
+*/
+int append_term(const char *str, struct program *prog){
+	int i = add_term(&prog->terms, str, str ? TERM_REF : TERM_SLOT,
+			prog->line_count, prog->mem);
+	if(!i)
+		print_memory_error(prog);
+	return i;
+}
 
-		if(reg != -1){
-			child = create_single_char_term(dtoc(reg-1), 0);
-			child->absolute_pos = prog->line_count;
-			child->trans = 1;
-			add_child_term(child, t, prog);
-			if(!or)
-				reg = -1;
-		}
-		c++;
+/**
+* Packs the register number into the instruction word, after the opcode and
+* any registers before it.
+*/
+static void add_reg_bits(short reg, int t, struct program *prog){
+
+	// all register values start at 1, so let's fix that
+	add_word_bits(&prog->terms, t, reg - 1, REG_BITS, WORD_SIZE);
+}
+
+/**
+* Operand parser for source registers.
+*
+* @param tok 		The operand token.
+* @param t 			The position of the instruction being built.
+* @param prog 		Used for error reporting.
+* @param quiet 		1 if this is one of several alternatives, in which case
+* 					failing is not an error.
+* @return 			1 if the token was accepted, otherwise 0.
+*/
+short parse_src_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	short reg = read_src_reg(tok, prog, quiet);
+	if(reg == -1)
+		return 0;
+	add_reg_bits(reg, t, prog);
+	return 1;
+}
+
+/**
+* Operand parser for destination registers, see parse_src_operand().
+*/
+short parse_dst_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	short reg = read_dst_reg(tok, prog, quiet);
+	if(reg == -1)
+		return 0;
+	add_reg_bits(reg, t, prog);
+	return 1;
+}
+
+/**
+* Operand parser for labels. Any token is accepted, it is resolved (as a
+* label, constant or literal) by translate_terms() once parsing is done.
+*/
+short parse_label_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	if(!append_term(tok, prog))
+		return 0;
+	TRACE(prog, TRACE_PARSE, TRACE_TERM, "label operand '%s'", tok);
+	return 1;
+}
+
+/**
+* Operand parser for constants, which must already have been defined.
+*/
+short parse_const_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	if(!check_const(tok, prog)){
+		if(!quiet)
+			print_expected_const(tok, prog);
+		return 0;
 	}
 
-	// Finally, add miscellaneous bits to the end
-	if(misc){
-		struct Term *mt = create_term(misc, strlen(misc), 0);
-		mt->trans = 1;
-		mt->absolute_pos = prog->line_count;
-		add_child_term(mt, t, prog);
+	TRACE(prog, TRACE_PARSE, TRACE_TERM, "constant operand '%s'", tok);
+	return append_term(tok, prog) != 0;
+}
+
+/**
+* Operand parser for explicit literals, which are translated right away.
+*/
+short parse_lit_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	if(!check_explicit_literal(tok, prog)){
+		if(!quiet)
+			print_expected_literal(tok, prog);
+		return 0;
 	}
+	int val = process_literal(tok, MAX_INT);
+	if(val < 0){
+		print_literal_too_large(tok, prog);
+		return 0;
+	}
+
+	TRACE(prog, TRACE_PARSE, TRACE_TERM, "literal operand %d", val);
+	int nt = append_term(0, prog);
+	if(!nt)
+		return 0;
+	prog->terms.words[nt] = val & WORD_MASK;
+	prog->terms.kinds[nt] = TERM_DONE;
+	return 1;
+}
+
+/**
+* Operand "parser" for placeholders, consumes no token and leaves an empty
+* word to be filled in during translation.
+*/
+short parse_term_operand(char *tok, int t, struct program *prog,
+		short quiet){
+	return append_term(0, prog) != 0;
 }
 
 /**
 * Checks for any unprocessed tokens that may have been left in the buffer.
 */
 void check_garbage(struct program *prog){
-	#ifdef DEBUG
-		fprintf(stderr, "Checking for garbage at EOL...\n");
-	#endif
 	char *tok;
-	if((tok = strtok(0, STR_TOK_SEP))){
+	if((tok = next_token(&prog->src, STR_TOK_SEP))){
 		if(!check_comment(tok, prog))
 			print_unexpected_ident(tok, prog);
 	}
 }
 
 /**
-* Simply writes the given string to the given file in a standardized format.
-*/
-void write_str(char *str, FILE *out){
-	fprintf(out, "%s\n", str);
-}
-
-/**
-* Will attempt to find a source register of the given format:
+* Will attempt to read a source register of the given format:
 * $S<x>
 * Note, that x MUST be between 1 and MAX_REGS (inclusively). The token is
 * rejected if all 3 characters are not of the given format.
 *
+* @param tok The token to read
 * @param prog Used for error reporting
 * @param suppress suppresses error messages if 1
 * @return -1 on failure, otherwise the numbered register that
 * was parsed.
 */
-short read_src_reg(struct program *prog, short suppress){
-	char *tok = read_reg(prog, suppress);
-	if(!tok)
-		return -1;
-	short reg = 0;
-	if(tok[1] != 'S' || !(reg = atoi(tok+2)) || reg > MAX_REGS ||
-			reg < 1){
-		print_expected_ident(tok, "$Sx", prog);
-		return -1;
-	}
-	return reg;
+short read_src_reg(char *tok, struct program *prog, short suppress){
+	return read_reg(tok, 'S', prog, suppress);
 }
 
 /**
-* Like the 'read_src_reg()' function, will attempt to find a destination
+* Like the 'read_src_reg()' function, will attempt to read a destination
 * register of the given format:
 * $D<x>
-* Note, that x MUST be between 1 and MAX_REGS (inclusively). The token is
-* rejected if all 3 characters are not of the given format.
 *
+* @param tok 		The token to read
 * @param prog 		Used for error reporting
 * @param suppress 	suppresses error messages if 1
 * @return 			-1 on failure, otherwise the numbered register that
 * 					was parsed.
 */
-short read_dst_reg(struct program *prog, short suppress){
-	char *tok = read_reg(prog, suppress);
-	if(!tok)
-		return -1;
-	short reg = 0;
-	if(tok[1] != 'D' || !(reg = atoi(tok+2)) || reg > MAX_REGS ||
-			reg < 1){
-		print_expected_ident(tok, "$Dx", prog);
-		return -1;
-	}
-	return reg;
+short read_dst_reg(char *tok, struct program *prog, short suppress){
+	return read_reg(tok, 'D', prog, suppress);
 }
 
 /**
-* A general purpose function for ensuring the current token is of a valid
-* register type. Note, the token is rejected if the register is not exactly 3
-* characters or does not start with a '$'.
+* A general purpose function for ensuring the token is of a valid register
+* type. Note, the token is rejected if the register is not exactly 3
+* characters, does not start with a '$' or is not of the given kind.
 *
+* @param tok The token to read
+* @param kind 'S' for a source or 'D' for a destination register
 * @param prog Used for error reporting
 * @param suppress suppresses error messages if 1
-* @return 0 on failure, otherwise the register string that was
-* parsed.
+* @return -1 on failure, otherwise the numbered register that
+* was parsed.
 */
-char *read_reg(struct program *prog, short suppress){
-	char * tok = strtok(0, ", \t");
+short read_reg(char *tok, char kind, struct program *prog, short suppress){
 	trimwhitespace(tok);
 
 	// should only be 3 characters (may change, but sufficient for now)
 	if(strlen(tok) != 3 || tok[0] != '$'){
-		print_expected_ident(tok, "$", prog);
-		tok = 0;
-	}
-	return tok;
-}
-
-/**
-* For more complex instructions that will come in pieces, this is useful as it
-* will print the "binary" data in the order of the parameters. Note that misc
-* is a "catch all" that can be used to print an arbitrary number of
-* characters.
-*/
-void write_instruc_str(char *str, short s1, short s2, short dest, char *misc,
-		struct program *prog){
-	int total = 0;
-	char *buf = 0;
-	total = fprintf(prog->out, "%s", str);
-	if(s1){
-		buf = conv_reg_to_str(buf, s1);
-		total += fprintf(prog->out, "%s", buf);
-	}
-	if(s2){
-		buf = conv_reg_to_str(buf, s2);
-		total += fprintf(prog->out, "%s", buf);
-	}
-	if(dest){
-		buf = conv_reg_to_str(buf, dest);
-		total += fprintf(prog->out, "%s", buf);
-	}
-	if(misc)
-		total += fprintf(prog->out, "%s", misc);
-	free(buf);
-	while(total < WORD_SIZE){
-		fprintf(prog->out, "%d", 0);
-		total++;
+		if(!suppress)
+			print_expected_ident(tok, "$", prog);
+		return -1;
 	}
-	fprintf(prog->out, "\n");
-}
-
-/**
-* Given a base-10 number, the provided buf will have its contents filled with
-* a binary string representative of the given base-10 value. Note, if the
-* provided string buffer is not of the appropriate size the buffer is
-* automatically freed and reallocated.
-*/
-char *conv_reg_to_str(char *buf, short reg){
-	int char_count = log10(MAX_REGS)/log10(2);
-	#ifdef DEBUG
-		fprintf(stderr, "%p\n", buf);
-	#endif
-
-	// resize the buffer
-	if(!buf || strlen(buf) != char_count){
-		if(buf)
-			free(buf);
-		buf = (char*) malloc(char_count);
+	short reg = 0;
+	if(tok[1] != kind || !(reg = atoi(tok+2)) || reg > MAX_REGS ||
+			reg < 1){
+		if(!suppress)
+			print_expected_ident(tok, kind == 'S' ? "$Sx" : "$Dx", prog);
+		return -1;
 	}
-
-	// all register values start at 1, so let's fix that
-	reg--;
-	do{
-		if(reg%2)
-			buf[char_count-1] = '1';
-		else
-			buf[char_count-1] = '0';
-		reg /= 2;
-		char_count--;
-	}while(char_count);
-	return buf;
+	return reg;
 }
 
 /**
-* Given a linked-list of terms, will resolve identifiers and translate
+* Given the table of terms, will resolve identifiers and translate
 * remaining values into binary for printing.
 *
-* @param t The root term to translate
 * @param prog Contains all program information for general purpose use,
-* including error reporting.
+* including the terms and error reporting.
 */
-void translate_terms(struct Term * t, struct program *prog){
+void translate_terms(struct program *prog){
 
 	// vars
+	struct term_table *tt = &prog->terms;
 	struct symbol *s = 0;
 	struct symbol *cur_func = 0;
-	int diff, term_pos = 1;
+	int diff, t = 1;
 
-	#ifdef DEBUG
-		fprintf(stderr, "LAST TERM: %s TRANS: %d\n", prog->end_term->term,
-				prog->end_term->trans);
-	#endif
+	TRACE(prog, TRACE_RESOLVE, TRACE_PHASE, "resolving %d terms", tt->count);
 
 	// consume all terms
-	while(t){
+	while(t <= tt->count){
 
-		#ifdef DEBUG
-			fprintf(stderr, "CUR TERM: %s, TRANS: %d\n", t->term, t->trans);
-		#endif
+		TRACE(prog, TRACE_RESOLVE, TRACE_TERM, "term %d '%s' kind %d", t,
+				tt->refs[t], tt->kinds[t]);
 		
-		// check if we are under a new function
-		if( (s = find_symbol_at(term_pos, prog->tbl)) ){
-			cur_func = s;
-			s = 0;
+		// a return goes back to the last function placed before it
+		while( (s = next_symbol_before(t, &prog->pos_idx)) ){
+			if(s->type == FUNC_TYPE)
+				cur_func = s;
 		}
 
 		// We need to process CALL instructions a little differently
-		if(!strcmp(t->term, STJ)){
+		if(tt->ops[t] == OP_STJ){
 			
 			// The next two terms need to be translated differently
-			struct Term *jmp_back = t->next_term;
-			struct Term *jmp_to = jmp_back->next_term;
-			term_pos += 2;
-			if( (s = find_symbol(jmp_to->term, prog->tbl)) ){
+			int jmp_back = t + 1;
+			int jmp_to = t + 2;
+			if( (s = find_symbol(tt->refs[jmp_to], prog->tbl)) ){
 				if(s->type != FUNC_TYPE){
-					print_non_func_call(s, prog, t->absolute_pos);
+					print_non_func_call(s, prog, tt->lines[t]);
 					return;
 				}
-				diff = s->pos - t->pos - 2;
+				diff = s->pos - t - 2;
 				if(diff < 0)
 					diff = MAX_MEMORY + diff;
 
-				// Assume we are returning from the definition of the function,
-				// the LFSJ instruction will apply the necessary offset to
-				// this value.  We need to add one to get around the jump
-				// r-pointer upon returning.
-				jmp_back->term = numtob( (MAX_MEMORY - diff + 1), WORD_SIZE);
-				jmp_back->trans = 1;
+				// The return takes this from its own distance to the start of
+				// the function, which leaves the distance back to here.
+				tt->words[jmp_back] = diff & WORD_MASK;
+				tt->kinds[jmp_back] = TERM_DONE;
 
 				// Just jump to the function definition
-				jmp_to->term = numtob(diff, WORD_SIZE);
-				jmp_to->trans = 1;
+				tt->words[jmp_to] = diff & WORD_MASK;
+				tt->kinds[jmp_to] = TERM_DONE;
 			}
 		}
-		else if(!strcmp(t->term, LFSJ)){
+		else if(tt->ops[t] == OP_LFSJ){
 			
 			// make sure we are currently under a function
 			if(!cur_func){
-				print_return_from_non_func(t->absolute_pos, prog);
+				print_return_from_non_func(tt->lines[t], prog);
 				return;
 			}
 			else{
@@ -787,97 +943,142 @@ void translate_terms(struct Term * t, struct program *prog){
 
 				// compute difference to start of function, set as diff
 				// for text value
-				#ifdef DEBUG
-					fprintf(stderr, "Processing return...\n");
-				#endif
-				t = t->next_term;
-				diff = cur_func->pos - t->pos;
-				// We need to add one since we will be on the r-pointer itself
-				// and not on the instruction saying to return
-				t->term = numtob(diff + 2, WORD_SIZE);
-				t->trans = 1;
-				term_pos++;
+				TRACE(prog, TRACE_RESOLVE, TRACE_LINE, "return at %d to '%s'",
+						t, cur_func->iden);
+				t++;
+				diff = cur_func->pos - t;
+				if(diff < 0)
+					diff = MAX_MEMORY + diff;
+
+				// A whole turn further, so that taking the call's word away
+				// never goes below zero; words wrap at WORD_MASK, not at the
+				// size of the ring.
+				tt->words[t] = (diff + MAX_MEMORY) & WORD_MASK;
+				tt->kinds[t] = TERM_DONE;
 
 
 			}
 		}
-		else if(!t->trans){
+		else if(tt->kinds[t] != TERM_DONE){
 			
-			#ifdef DEBUG
-				fprintf(stderr, "%s %d\n", t->term, t->trans);
-			#endif
-
 			// check for symbols that still need to be translated
-			if( check_explicit_literal(t->term, prog) ){
-				t->term = numtob(stonum(t->term+1), WORD_SIZE);
+			if( check_explicit_literal(tt->refs[t], prog) ){
+				tt->words[t] = stonum(tt->refs[t]+1) & WORD_MASK;
 			}
 			else{
 
 				// We have a symbol to parse
-				if( (s = find_symbol(t->term, prog->tbl)) ){
+				if( (s = find_symbol(tt->refs[t], prog->tbl)) ){
 
 					// mark as used
 					s->used = 1;
 
 					// we have a label to resolve
-					diff = s->pos - t->pos;
+					diff = s->pos - t;
 					if(diff < 0){
 					diff = MAX_MEMORY + diff;
 					}
-					t->term = numtob(diff, WORD_SIZE);
+					tt->words[t] = diff & WORD_MASK;
 				}
-				else if( (s = find_symbol(t->term, prog->const_tbl)) ){
+				else if( (s = find_symbol(tt->refs[t], prog->const_tbl)) ){
 
 					s->used = 1;
 
 					// looks like a constant was used
-					t->term = numtob(s->val, WORD_SIZE);
+					tt->words[t] = s->val & WORD_MASK;
 				}
 				else{
 					// TODO: use the standard print_compiler_error message
-					print_symbol_not_found(t->term, prog);
+					print_symbol_not_found(tt->refs[t], prog);
 					return;
 				}
 			}
 		}
-		t = t->next_term;
-		term_pos++;
+		t++;
 	}
 
 }
 
 /**
 * Handles the final step in compilation of writing the terms to the output
-* file.
+* file. The words are already laid out in text ring order, so they are
+* handed over as they are.
 *
-* @param t 			The root term to be processed.
 * @param program 	Contains all general program information gathered thus far,
 * 					primarily used for error reporting.
 */
-void write_terms(struct Term *t, struct program *program){
-
-	int c = 0;
-	int total_bits = 0;
-	static const char *filler = "0000000";
-	while(t){
-		#ifdef DEBUG
-			fprintf(stderr, "NEXT TERM! %d\n", t->child_count);
-		#endif
-		total_bits = fprintf(program->out, "%s", t->term);
-		while(c < t->child_count && t->child_terms[c]){
-			#ifdef DEBUG
-				fprintf(stderr, "CHILD TERM %p\n", t->child_terms[c]);
-			#endif
-			total_bits += fprintf(program->out, "%s", t->child_terms[c]->term);
-			c++;
+void write_terms(struct program *program){
+	struct term_table *tt = &program->terms;
+	int i;
+	TRACE(program, TRACE_WRITE, TRACE_PHASE, "writing %d words", tt->count);
+	if(TRACE_ON(TRACE_WRITE, TRACE_TERM)){
+		for(i = 1; i <= tt->count; i++)
+			trace_print(program, TRACE_WRITE, "word %d %s", i,
+					word_strs[tt->words[i]]);
+	}
+	emit_words(tt->count ? tt->words + 1 : (const unsigned char *) "",
+			tt->count, program);
+}
+
+/**
+* Writes the program image in the selected output format. The whole image is
+* rendered into one buffer first and then handed to the file in a single
+* write. Without an output file, a copy of the words is kept in the program
+* instead (see hartz_translate()).
+*
+* @param words 		The encoded words of the program.
+* @param count 		The number of words.
+* @param program 	Used for the output file and error reporting.
+*/
+void emit_words(const unsigned char *words, size_t count, 
+		struct program *program){
+	size_t line = WORD_SIZE + 1;
+	size_t len, i;
+	char *buf;
+
+	if(!program->out){
+		if(!(program->image = (unsigned char *) malloc(count ? count : 1))){
+			print_memory_error(program);
+			return;
 		}
-		if(total_bits != WORD_SIZE){
-			fprintf(program->out, "%s", (filler + total_bits) );
+		memcpy(program->image, words, count);
+		program->image_len = count;
+		program->stats.words = count;
+		program->stats.written = count;
+		return;
+	}
+
+	if(program->opts.out_format == OUT_TEXT)
+		len = count * line;
+	else
+		len = image_size(count, WORD_SIZE, program->opts.out_format == OUT_PACKED ? 
+				IMG_PACKED : IMG_BYTES);
+	if(!(buf = (char *) malloc(len ? len : 1))){
+		print_memory_error(program);
+		return;
+	}
+
+	if(program->opts.out_format == OUT_TEXT){
+		for(i = 0; i < count; i++){
+			memcpy(buf + i * line, word_strs[words[i] & WORD_MASK], 
+					WORD_SIZE);
+			buf[i * line + WORD_SIZE] = '\n';
 		}
-		fprintf(program->out, "\n");
-		c = 0;
-		t = t->next_term;
 	}
+	else{
+		write_image(buf, words, count, WORD_SIZE, MAX_MEMORY, 
+				program->opts.out_format == OUT_PACKED ? IMG_PACKED : IMG_BYTES);
+	}
+
+	if(fwrite(buf, 1, len, program->out) != len){
+		report_at(program, DIAG_ERROR, FAULT, NO_LINE, 
+				"Error: Unable to write the program image.");
+	}
+	else{
+		program->stats.words = count;
+		program->stats.written = len;
+	}
+	free(buf);
 }
 
 /**
@@ -912,11 +1113,21 @@ void check_warnings(struct program *prog){
 void print_help(const char *prog_name){
 	printf("usage: %s <input-file> <output-file> [flags]\n"
 			"Options (make separate):\n"
+			" -a\tWrite the output file atomically\n"
+			" -b\tWrite a binary image, one byte per word\n"
 			" -f\tMake Code Faster (TM)\n"
 			" -h\tPrint help\n"
 			" -i\tPrint system information\n"
+			" -O\tShorten the program with a peephole pass\n"
+			" -p\tWrite a binary image of packed words\n"
 			" -s\tPrint the symbol tables\n"
-			" -w\tTurn on (all) warnings\n",
-			prog_name);
+			" -t\tPrint the time of each phase and other counters\n"
+			" -T <traces>\tTrace to stderr, e.g. 'parse=2,resolve' or 'all'\n"
+			" -w\tTurn on (all) warnings\n"
+			"\n"
+			"usage: %s -m <manifest> [-j <workers>] [flags]\n"
+			"Translates every '<input-file> <output-file>' line of the\n"
+			"manifest ('-' for stdin) on a pool of worker threads.\n",
+			prog_name, prog_name);
 }
 
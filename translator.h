@@ -1,41 +1,60 @@
 #ifndef translator_h_
 #define translator_h_
 
-// debug print control
-#define DEBUG // general purpose debug messages
-
 // Machine Constraints
 #define MAX_REGS 		2
-#define REG_ONE 		"$1"
-#define REG_TWO 		"$2"
 #define MAX_MEMORY 		28
 #define MAX_CACHE 		6
-#define MAX_LINE_LEN 	32
 #define WORD_SIZE 		7
 #define MAX_INT			127
+#define WORD_MASK		MAX_INT	// keeps the low WORD_SIZE bits of a value
+#define REG_BITS		1		// bits needed to name one of MAX_REGS
 
 // (Real) Instructions
-// 		Name 	Code 		Description
-#define NOT 	"0000" 		// bitwise not of $source into $dest
-#define SHL 	"0001" 		// a left bitwise shift, once
-#define SHR 	"0010" 		// a right bitwise shift, once
-#define OR 		"0011" 		// bitwise or of $s1 and $s2 into $dest
-#define AND 	"0100" 		// bitwise and of $s1 and $s1 into $dest
-#define ADD 	"0101" 		// binary addition of $s1 and $s2 into $dest
-#define SW 		"01100"		// store word to cache
-#define SI		"01101"		// stores next value on text into data
-#define LW 		"01110" 	// load word from cache into $dest
-#define LI		"01111"		// Loads the next value on the text ring
-#define BEZ 	"1000" 		// branch if $source equal to zero
-#define ROT 	"10010" 	// increase cache index by $source
-#define ROT1 	"1001100" 	// increase cache index by one
-#define LROT 	"1001010"	// move cache index by value on text ring
-#define LJMP 	"1010" 		// apply scalar to next jump
-#define JMP 	"1011" 		// next value is a pointer
-#define HALT 	"1111000" 	// stops all processing
-#define NOP 	"1111100" 	// consumes a cycle
-#define LFSJ	"1111010"	// load from DR, subtract, & jump
-#define STJ		"1111110"	// store to DR & jump
+// The code is left aligned in the word, operand bits follow directly after
+// 		Name 	Code 	Bits		Description
+#define NOT 	0x00 	// 0000		bitwise not of $source into $dest
+#define SHL 	0x08 	// 0001		a left bitwise shift, once
+#define SHR 	0x10 	// 0010		a right bitwise shift, once
+#define OR 		0x18 	// 0011		bitwise or of $s1 and $s2 into $dest
+#define AND 	0x20 	// 0100		bitwise and of $s1 and $s1 into $dest
+#define ADD 	0x28 	// 0101		binary addition of $s1 and $s2 into $dest
+#define SW 		0x30	// 01100	store word to cache
+#define SI		0x34	// 01101	stores next value on text into data
+#define LW 		0x38 	// 01110	load word from cache into $dest
+#define LI		0x3C	// 01111	Loads the next value on the text ring
+#define BEZ 	0x40 	// 1000		branch if $source equal to zero
+#define ROT 	0x48 	// 10010	increase cache index by $source
+#define ROT1 	0x4C 	// 1001100	increase cache index by one
+#define LROT 	0x4A	// 1001010	move cache index by value on text ring
+#define LJMP 	0x50 	// 1010		apply scalar to next jump
+#define JMP 	0x58 	// 1011		next value is a pointer
+#define HALT 	0x78 	// 1111000	stops all processing
+#define NOP 	0x7C 	// 1111100	consumes a cycle
+#define LFSJ	0x7A	// 1111010	load from DR, subtract, & jump
+#define STJ		0x7E	// 1111110	store to DR & jump
+
+// Instruction Code Lengths (in bits)
+#define NOT_L 	4
+#define SHL_L 	4
+#define SHR_L 	4
+#define OR_L 	4
+#define AND_L 	4
+#define ADD_L 	4
+#define SW_L 	5
+#define SI_L	5
+#define LW_L 	5
+#define LI_L	5
+#define BEZ_L 	4
+#define ROT_L 	5
+#define ROT1_L 	7
+#define LROT_L	7
+#define LJMP_L 	4
+#define JMP_L 	4
+#define HALT_L 	7
+#define NOP_L 	7
+#define LFSJ_L	7
+#define STJ_L	7
 
 // Instruction Format Codes
 #define NOT_F 	"sd"
@@ -64,32 +83,99 @@
 #define COMP_INFO "-i"
 #define HELP_FLAG "-h"
 #define FAST_FLAG "-f"
+#define ATOM_FLAG "-a"
+#define BYTE_FLAG "-b"
+#define PACK_FLAG "-p"
+#define JOBS_FLAG "-j"		// followed by the number of workers
+#define BATCH_FLAG "-m"		// in place of the input file, then the manifest
+#define OPT_FLAG "-O"
+#define TIME_FLAG "-t"
+#define TRACE_FLAG "-T"		// followed by what to trace, see trace.h
+#define FLAG_CNT	13
+
+// Output Formats
+#define OUT_TEXT	0	// one line of '0'/'1' characters per word
+#define OUT_BYTES	1	// binary image, one byte per word (see image.h)
+#define OUT_PACKED	2	// binary image, words packed back to back
+
+// Output Files
+#define TEMP_NAME	"%s.%ld.%lu"	// the file, pid and a count, for atomic writes
+#define TEMP_EXTRA	48		// room TEMP_NAME needs beyond the file's name
+#define TEMP_TRIES	100		// names tried before giving up on a temporary file
+
+/**
+ * translation
+ * The outcome of translate_memory(), all output collected in memory.
+ *
+ * char *out			The program image, in the chosen output format
+ * size_t out_len		The number of bytes in out
+ * char *msg			Everything that would have been printed to stdout
+ * size_t msg_len		The number of bytes in msg
+ * char *err			Everything that would have been printed to stderr
+ * size_t err_len		The number of bytes in err
+ * int error_code		The error code of the translation, 0 on success
+ */
+struct translation{
+	char *out;
+	size_t out_len;
+	char *msg;
+	size_t msg_len;
+	char *err;
+	size_t err_len;
+	int error_code;
+};
 
 struct program;
-struct Term;
+struct opcode;
+struct options;
+
+// Translation Drivers
+int translate_file(const char *input, const char *output, 
+const struct options *opts);
+int translate_memory(const char *input, size_t size, const char *name,
+const struct options *opts, struct translation *res);
+void free_translation(struct translation *res);
+int translate_batch(const char *manifest, int workers, 
+const struct options *opts);
+void *batch_worker(void *arg);
 
 // Compilation Functions
+void run_translation(struct program *prog);
+void print_result(struct program *prog);
 void process_input_program(struct program *prog);
+void translate_program(struct program *prog);
 
 // Program File Output Functions
-void write_str(char *str, FILE *out);
-void write_instruc_str(char *str, short s1, short s2, short dest, char *misc,
+void emit_words(const unsigned char *words, size_t count, 
 struct program *prog);
 
 // Instruction Processing Fucntions
 void process_token(char *tok, struct program *prog);
-void process_instruction(struct program *prog, char *opcode, const char *fmt,
-char *misc);
+void process_instruction(struct program *prog, const struct opcode *op);
+int append_term(const char *str, struct program *prog);
+
+// Operand Parsers
+short parse_src_operand(char *tok, int t, struct program *prog,
+short quiet);
+short parse_dst_operand(char *tok, int t, struct program *prog,
+short quiet);
+short parse_label_operand(char *tok, int t, struct program *prog,
+short quiet);
+short parse_const_operand(char *tok, int t, struct program *prog,
+short quiet);
+short parse_lit_operand(char *tok, int t, struct program *prog,
+short quiet);
+short parse_term_operand(char *tok, int t, struct program *prog,
+short quiet);
 
 // Term translation
-void translate_terms(struct Term *t, struct program *prog);
-void write_terms(struct Term *t, struct program *prog);
+void translate_terms(struct program *prog);
+void write_terms(struct program *prog);
 
 // Register Processing Instructions
-short read_src_reg(struct program *prog, short suppress);
-short read_dst_reg(struct program *prog, short suppress);
-char *read_reg(struct program *prog, short suppress);
-char *conv_reg_to_str(char *buf, short reg);
+short read_src_reg(char *tok, struct program *prog, short suppress);
+short read_dst_reg(char *tok, struct program *prog, short suppress);
+short read_reg(char *tok, char kind, struct program *prog, short suppress);
 
 // Error Handling Functions
 void check_garbage(struct program *prog);
@@ -97,6 +183,8 @@ void check_warnings(struct program *prog);
 
 // Miscellaneous File/String Manipulators
 FILE *open_write_file(const char *file);
+FILE *open_temp_file(const char *file, char **tmp_name);
+int close_write_file(FILE *out, const char *file, char *tmp_name, short keep);
 
 // Other
 void print_help(const char *prog_name);